@@ -0,0 +1,82 @@
+#ifndef SPINNING_LIDAR_UTILS_POINT_CLOUD_UTILS_H
+#define SPINNING_LIDAR_UTILS_POINT_CLOUD_UTILS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <sensor_msgs/PointCloud2.h>
+
+
+namespace spinning_lidar_utils
+{
+
+// Appends the points of one cloud to another with the same point layout. An
+// empty output takes the header and layout of the input.
+inline bool appendCloud(const sensor_msgs::PointCloud2& cloud, sensor_msgs::PointCloud2& out)
+{
+  if (out.data.empty())
+  {
+    out.header = cloud.header;
+    out.fields = cloud.fields;
+    out.point_step = cloud.point_step;
+    out.is_bigendian = cloud.is_bigendian;
+    out.is_dense = true;
+  }
+  else if (cloud.point_step != out.point_step || cloud.fields.size() != out.fields.size())
+  {
+    return false;
+  }
+  out.data.insert(out.data.end(), cloud.data.begin(), cloud.data.end());
+  out.height = 1;
+  out.width = (out.point_step > 0) ? out.data.size() / out.point_step : 0;
+  out.row_step = out.data.size();
+  out.is_dense = out.is_dense && cloud.is_dense;
+  return true;
+}
+
+// Copies each point of a cloud into outputs[label] according to its label, one
+// per point. Points labelled num_outputs or more, or whose output is NULL, are
+// dropped. The outputs keep the header and point layout of the input.
+inline void splitCloudByLabel(const sensor_msgs::PointCloud2& cloud, const std::vector<uint8_t>& point_labels,
+                              sensor_msgs::PointCloud2* const* outputs, size_t num_outputs)
+{
+  for (size_t c = 0; c < num_outputs; c++)
+  {
+    if (outputs[c])
+    {
+      outputs[c]->header = cloud.header;
+      outputs[c]->fields = cloud.fields;
+      outputs[c]->is_bigendian = cloud.is_bigendian;
+      outputs[c]->point_step = cloud.point_step;
+      outputs[c]->is_dense = cloud.is_dense;
+      outputs[c]->height = 1;
+      outputs[c]->data.clear();
+    }
+  }
+
+  const size_t num_points = std::min(point_labels.size(), static_cast<size_t>(cloud.width) * cloud.height);
+  for (size_t p = 0; p < num_points; p++)
+  {
+    const uint8_t label = point_labels[p];
+    if (label >= num_outputs || !outputs[label])
+    {
+      continue;
+    }
+    const uint8_t* point = &cloud.data[p * cloud.point_step];
+    outputs[label]->data.insert(outputs[label]->data.end(), point, point + cloud.point_step);
+  }
+
+  for (size_t c = 0; c < num_outputs; c++)
+  {
+    if (outputs[c])
+    {
+      outputs[c]->width = (cloud.point_step > 0) ? outputs[c]->data.size() / cloud.point_step : 0;
+      outputs[c]->row_step = outputs[c]->data.size();
+    }
+  }
+}
+
+}  // namespace spinning_lidar_utils
+
+#endif  // SPINNING_LIDAR_UTILS_POINT_CLOUD_UTILS_H
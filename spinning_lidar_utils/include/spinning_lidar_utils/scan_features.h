@@ -0,0 +1,65 @@
+#ifndef SPINNING_LIDAR_UTILS_SCAN_FEATURES_H
+#define SPINNING_LIDAR_UTILS_SCAN_FEATURES_H
+
+#include <cstdint>
+#include <vector>
+
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
+
+
+// LOAM-style edge/planar feature extraction on single 2D scans.
+// Curvature is computed in the scan plane using the beam ordering of the
+// LaserScan, so it has to run before the scan is projected and assembled.
+// Reference: Zhang & Singh, "LOAM: Lidar Odometry and Mapping in Real-time"
+namespace spinning_lidar_utils
+{
+
+enum ScanFeatureLabel
+{
+  FEATURE_NONE = 0,
+  FEATURE_EDGE = 1,
+  FEATURE_PLANAR = 2
+};
+
+struct ScanFeatureParams
+{
+  int curvature_window = 20;        // beams on each side used for the curvature
+  int smoothing_window = 4;         // beams on each side averaged for the center point
+  int num_regions = 6;              // the scan is split in regions to spread features
+  int max_edges_per_region = 2;
+  int max_planars_per_region = 4;
+  double edge_threshold = 0.03;     // curvature, |sum(X_j - X_i)| / (2k |X_i|) as in LOAM
+  double planar_threshold = 0.005;
+  double occlusion_ratio = 0.1;     // relative jump between neighbours marking an occlusion
+};
+
+
+class ScanFeatureExtractor
+{
+public:
+  explicit ScanFeatureExtractor(const ScanFeatureParams& params = ScanFeatureParams());
+
+  // Labels each beam of the scan with a ScanFeatureLabel
+  void extract(const sensor_msgs::LaserScan& scan, std::vector<uint8_t>& labels);
+
+  // Splits a cloud projected by laser_geometry (which must keep the "index"
+  // channel) into edge and planar clouds, according to the per-beam labels
+  static bool splitCloud(const sensor_msgs::PointCloud2& cloud, const std::vector<uint8_t>& labels,
+                         sensor_msgs::PointCloud2& edge_cloud, sensor_msgs::PointCloud2& planar_cloud);
+
+private:
+  ScanFeatureParams params_;
+  // Structure-of-arrays buffers, reused between scans
+  std::vector<float> x_, y_, range_sq_, sum_x_, sum_y_, curvature_;
+  std::vector<uint8_t> valid_, picked_;
+  std::vector<int> order_;
+
+  void computeCurvature(const sensor_msgs::LaserScan& scan);
+  void markUnreliable(const sensor_msgs::LaserScan& scan);
+  void pickNeighbours(int i, int n);
+};
+
+}  // namespace spinning_lidar_utils
+
+#endif  // SPINNING_LIDAR_UTILS_SCAN_FEATURES_H
@@ -0,0 +1,37 @@
+#ifndef SPINNING_LIDAR_UTILS_SCAN_FILTERING_H
+#define SPINNING_LIDAR_UTILS_SCAN_FILTERING_H
+
+#include <limits>
+
+#include <sensor_msgs/LaserScan.h>
+
+
+namespace spinning_lidar_utils
+{
+
+// LIDAR scan filtering: ranges closer than min_dist_to_sensor are set to inf
+// so they are dropped on projection (they could be the laser platform)
+// Reference: https://github.com/RobustFieldAutonomyLab/spin_hokuyo/blob/master/src/hokuyo_robot_filter.cpp
+inline void filterScan(const sensor_msgs::LaserScan& scan, double min_dist_to_sensor, sensor_msgs::LaserScan& filtered_scan)
+{
+  const float inf = std::numeric_limits<float>::infinity();
+  const int num_range_meas = scan.ranges.size();
+  filtered_scan.header = scan.header;
+  filtered_scan.angle_min = scan.angle_min;
+  filtered_scan.angle_max = scan.angle_max;
+  filtered_scan.angle_increment = scan.angle_increment;
+  filtered_scan.time_increment = scan.time_increment;
+  filtered_scan.scan_time = scan.scan_time;
+  filtered_scan.range_min = 0;
+  filtered_scan.range_max = inf;
+  filtered_scan.intensities.clear();
+  filtered_scan.ranges.resize(num_range_meas);
+  for (int n = 0; n < num_range_meas; n++)
+  {
+    filtered_scan.ranges[n] = (scan.ranges[n] > min_dist_to_sensor) ? scan.ranges[n] : inf;
+  }
+}
+
+}  // namespace spinning_lidar_utils
+
+#endif  // SPINNING_LIDAR_UTILS_SCAN_FILTERING_H
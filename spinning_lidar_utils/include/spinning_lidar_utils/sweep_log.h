@@ -0,0 +1,150 @@
+#ifndef SPINNING_LIDAR_UTILS_SWEEP_LOG_H
+#define SPINNING_LIDAR_UTILS_SWEEP_LOG_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <ros/time.h>
+#include <sensor_msgs/PointCloud2.h>
+
+
+// Sweep log: a flat, indexed file of assembled sweeps (PointCloud2) that can be
+// mmap'ed and read without deserializing anything.
+//
+// Layout (little endian, every block aligned to SWEEP_LOG_ALIGNMENT bytes):
+//   SweepLogFileHeader
+//   [SweepChunkHeader | SweepLogField x num_fields | frame_id | point data] x N
+//   SweepLogIndexEntry x N
+//
+// The index is written when the log is closed and its offset is patched into
+// the file header. Logs left without an index (e.g. the node was killed) are
+// still readable, the reader rebuilds the index by walking the chunks.
+namespace spinning_lidar_utils
+{
+
+const char SWEEP_LOG_MAGIC[8] = {'S', 'L', 'S', 'W', 'E', 'E', 'P', '\0'};
+const uint32_t SWEEP_LOG_VERSION = 1;
+const uint32_t SWEEP_CHUNK_MAGIC = 0x30505753;  // "SWP0"
+const size_t SWEEP_LOG_ALIGNMENT = 16;
+const size_t SWEEP_LOG_FIELD_NAME_LEN = 32;
+
+struct SweepLogFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t index_offset;  // 0 while the log is still being written
+  uint64_t num_sweeps;
+};
+
+struct SweepChunkHeader
+{
+  uint32_t magic;
+  uint32_t num_fields;
+  uint64_t stamp_ns;
+  uint32_t width;
+  uint32_t height;
+  uint32_t point_step;
+  uint32_t row_step;
+  uint8_t is_bigendian;
+  uint8_t is_dense;
+  uint16_t frame_id_len;
+  uint32_t reserved;
+  uint64_t data_offset;  // relative to the start of the chunk
+  uint64_t data_size;
+  uint64_t chunk_size;   // total size of the chunk, including padding
+};
+
+struct SweepLogField
+{
+  char name[SWEEP_LOG_FIELD_NAME_LEN];
+  uint32_t offset;
+  uint32_t count;
+  uint8_t datatype;
+  uint8_t reserved[7];
+};
+
+struct SweepLogIndexEntry
+{
+  uint64_t stamp_ns;
+  uint64_t offset;
+};
+
+
+// Zero-copy view of a sweep stored in a mapped log. Pointers stay valid as long
+// as the SweepLogReader that produced them is open.
+struct SweepView
+{
+  const SweepChunkHeader* header;
+  const SweepLogField* fields;
+  const char* frame_id;
+  const uint8_t* data;
+
+  ros::Time stamp() const;
+  std::string frameId() const;
+  size_t numPoints() const { return static_cast<size_t>(header->width) * header->height; }
+  // Byte offset of a field inside a point, or -1 if the sweep doesn't have it
+  int fieldOffset(const std::string& name) const;
+};
+
+
+class SweepLogWriter
+{
+public:
+  SweepLogWriter();
+  ~SweepLogWriter();
+
+  // Fails if the file already exists, so recordings are never overwritten
+  bool open(const std::string& path);
+  bool append(const sensor_msgs::PointCloud2& cloud);
+  void close();
+  bool isOpen() const { return file_ != NULL; }
+  // True after a write error, from then on append() refuses new sweeps
+  bool failed() const { return failed_; }
+  size_t size() const { return index_.size(); }
+
+private:
+  FILE* file_;
+  uint64_t offset_;
+  bool failed_;
+  std::vector<SweepLogIndexEntry> index_;
+
+  bool writeBlock(const void* data, size_t size);
+  bool writePadding();
+};
+
+
+class SweepLogReader
+{
+public:
+  SweepLogReader();
+  ~SweepLogReader();
+
+  bool open(const std::string& path);
+  void close();
+  bool isOpen() const { return map_ != NULL; }
+
+  size_t size() const { return index_.size(); }
+  ros::Time stamp(size_t i) const;
+  SweepView sweep(size_t i) const;
+  // Index of the first sweep stamped at or after t (size() if there is none)
+  size_t seek(const ros::Time& t) const;
+  // Deep copy of a sweep, for publishing it back into ROS
+  void toPointCloud2(size_t i, sensor_msgs::PointCloud2& cloud) const;
+
+private:
+  int fd_;
+  const uint8_t* map_;
+  size_t map_size_;
+  std::vector<SweepLogIndexEntry> index_;
+
+  bool loadIndex(const SweepLogFileHeader& file_header);
+  bool rebuildIndex();
+  bool validChunk(uint64_t offset) const;
+};
+
+}  // namespace spinning_lidar_utils
+
+#endif  // SPINNING_LIDAR_UTILS_SWEEP_LOG_H
@@ -0,0 +1,344 @@
+
+#include <cmath>
+#include <limits>
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
+#include <tf/transform_listener.h>
+#include <pcl_ros/transforms.h>
+
+
+// Cells per tile side. Each tile is a contiguous block of memory, so updates
+// coming from one scan touch few cache lines.
+const int TILE_SIZE = 16;
+const int TILE_CELLS = TILE_SIZE * TILE_SIZE;
+
+struct ElevationTile
+{
+  int key_x, key_y;  // tile coordinates in the map frame
+  bool dirty;
+  float max_z[TILE_CELLS];
+  float min_z[TILE_CELLS];
+  double stamp[TILE_CELLS];  // last time each cell was hit, in seconds
+  double oldest_stamp;       // lower bound of the stamps of the observed cells
+
+  void reset(int new_key_x, int new_key_y)
+  {
+    key_x = new_key_x;
+    key_y = new_key_y;
+    dirty = false;
+    std::fill(max_z, max_z + TILE_CELLS, -std::numeric_limits<float>::infinity());
+    std::fill(min_z, min_z + TILE_CELLS, std::numeric_limits<float>::infinity());
+    std::fill(stamp, stamp + TILE_CELLS, -std::numeric_limits<double>::infinity());
+    oldest_stamp = std::numeric_limits<double>::infinity();
+  }
+
+  // Forgets the cells last hit before the given time. Returns true if any was.
+  bool expire(double expired_before)
+  {
+    if (oldest_stamp >= expired_before)
+    {
+      return false;
+    }
+    bool expired = false;
+    oldest_stamp = std::numeric_limits<double>::infinity();
+    for (int cell = 0; cell < TILE_CELLS; cell++)
+    {
+      if (max_z[cell] == -std::numeric_limits<float>::infinity())
+      {
+        continue;
+      }
+      if (stamp[cell] < expired_before)
+      {
+        max_z[cell] = -std::numeric_limits<float>::infinity();
+        min_z[cell] = std::numeric_limits<float>::infinity();
+        stamp[cell] = -std::numeric_limits<double>::infinity();
+        expired = true;
+      }
+      else
+      {
+        oldest_stamp = std::min(oldest_stamp, stamp[cell]);
+      }
+    }
+    return expired;
+  }
+};
+
+// Floor division, also for negative coordinates
+inline int floorDiv(int a, int b)
+{
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+inline int positiveMod(int a, int b)
+{
+  return ((a % b) + b) % b;
+}
+
+
+// Robot-centric 2.5D elevation grid, updated with every filtered scan.
+// Tiles are stored in a circular buffer indexed by their map coordinates, so
+// when the robot moves only the tiles that enter the window are reset and the
+// grid is never copied. Tiles changed by a scan are published right away.
+// Cells keep the max/min height of the points that hit them. With a
+// cell_timeout, a cell not hit for that long is forgotten and its tile is
+// published again, so obstacles that moved away don't stay in the map forever.
+// Tiles are always published whole (see tilesToCloud), so a subscriber can
+// replace the tile it had with the one it receives.
+class ElevationGridMapper
+{
+public:
+  ros::NodeHandle nh_;
+  ros::Subscriber cloud_sub_;
+
+  ElevationGridMapper(ros::NodeHandle nh, std::string cloud_topic, std::string dirty_tiles_topic, std::string full_map_topic,
+                      std::string map_frame, std::string robot_frame, double resolution, int num_tiles, double max_point_height,
+                      double full_map_period, double cell_timeout) :
+    nh_(nh),
+    map_frame_(map_frame),
+    robot_frame_(robot_frame),
+    resolution_(resolution),
+    num_tiles_(num_tiles),
+    max_point_height_(max_point_height),
+    cell_timeout_(cell_timeout),
+    latest_stamp_(0.0),
+    center_key_x_(0),
+    center_key_y_(0)
+  {
+    tiles_.resize(num_tiles_ * num_tiles_);
+    for (size_t i = 0; i < tiles_.size(); i++)
+    {
+      // Keys no window can contain, so every slot gets reset on first use
+      tiles_[i].reset(std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+    }
+
+    cloud_sub_ = nh_.subscribe(cloud_topic, 10, &ElevationGridMapper::cloudCallback, this);
+    dirty_tiles_pub_ = nh_.advertise<sensor_msgs::PointCloud2>(dirty_tiles_topic, 10);
+    if (full_map_period > 0.0)
+    {
+      full_map_pub_ = nh_.advertise<sensor_msgs::PointCloud2>(full_map_topic, 1);
+      full_map_timer_ = nh_.createTimer(ros::Duration(full_map_period), &ElevationGridMapper::fullMapCallback, this);
+    }
+  }
+
+private:
+  ros::Publisher dirty_tiles_pub_, full_map_pub_;
+  ros::Timer full_map_timer_;
+  tf::TransformListener tf_listener_;
+  std::string map_frame_, robot_frame_;
+  double resolution_;
+  int num_tiles_;
+  double max_point_height_;
+  double cell_timeout_;
+  double latest_stamp_;
+
+  std::vector<ElevationTile> tiles_;
+  std::vector<int> dirty_slots_;
+  int center_key_x_, center_key_y_;
+
+  void cloudCallback(const sensor_msgs::PointCloud2::ConstPtr& cloud)
+  {
+    sensor_msgs::PointCloud2 map_cloud;
+    tf::StampedTransform robot_pose;
+    try
+    {
+      // The robot pose can be published later than the sensor transforms, wait for both
+      tf_listener_.waitForTransform(map_frame_, cloud->header.frame_id, cloud->header.stamp, ros::Duration(0.1));
+      tf_listener_.waitForTransform(map_frame_, robot_frame_, cloud->header.stamp, ros::Duration(0.1));
+      tf_listener_.lookupTransform(map_frame_, robot_frame_, cloud->header.stamp, robot_pose);
+    }
+    catch (tf::TransformException& e)
+    {
+      ROS_WARN_THROTTLE(1.0, "Scan dropped from the elevation grid: %s", e.what());
+      return;
+    }
+    if (!pcl_ros::transformPointCloud(map_frame_, *cloud, map_cloud, tf_listener_))
+    {
+      return;
+    }
+
+    // Scroll the window with the robot
+    const tf::Vector3& robot_position = robot_pose.getOrigin();
+    center_key_x_ = floorDiv(static_cast<int>(std::floor(robot_position.x() / resolution_)), TILE_SIZE);
+    center_key_y_ = floorDiv(static_cast<int>(std::floor(robot_position.y() / resolution_)), TILE_SIZE);
+    const int min_key_x = center_key_x_ - num_tiles_ / 2;
+    const int min_key_y = center_key_y_ - num_tiles_ / 2;
+    const float max_z = robot_position.z() + max_point_height_;
+    const float inv_resolution = 1.0 / resolution_;
+    latest_stamp_ = cloud->header.stamp.toSec();
+
+    // Forget the cells of the window that weren't hit for cell_timeout. Only
+    // tiles whose oldest cell expired are scanned.
+    if (cell_timeout_ > 0.0)
+    {
+      const double expired_before = latest_stamp_ - cell_timeout_;
+      for (size_t slot = 0; slot < tiles_.size(); slot++)
+      {
+        ElevationTile& tile = tiles_[slot];
+        if (inWindow(tile, min_key_x, min_key_y) && tile.expire(expired_before) && !tile.dirty)
+        {
+          tile.dirty = true;
+          dirty_slots_.push_back(slot);
+        }
+      }
+    }
+
+    const size_t num_points = static_cast<size_t>(map_cloud.width) * map_cloud.height;
+    sensor_msgs::PointCloud2ConstIterator<float> iter_x(map_cloud, "x"), iter_y(map_cloud, "y"), iter_z(map_cloud, "z");
+    for (size_t i = 0; i < num_points; ++i, ++iter_x, ++iter_y, ++iter_z)
+    {
+      const float z = *iter_z;
+      if (!std::isfinite(z) || z > max_z)
+      {
+        continue;
+      }
+
+      const int cell_x = static_cast<int>(std::floor(*iter_x * inv_resolution));
+      const int cell_y = static_cast<int>(std::floor(*iter_y * inv_resolution));
+      const int key_x = floorDiv(cell_x, TILE_SIZE);
+      const int key_y = floorDiv(cell_y, TILE_SIZE);
+      if (key_x < min_key_x || key_x >= min_key_x + num_tiles_ || key_y < min_key_y || key_y >= min_key_y + num_tiles_)
+      {
+        continue;
+      }
+
+      const int slot = positiveMod(key_y, num_tiles_) * num_tiles_ + positiveMod(key_x, num_tiles_);
+      ElevationTile& tile = tiles_[slot];
+      if (tile.key_x != key_x || tile.key_y != key_y)
+      {
+        // The slot held a tile that scrolled out of the window
+        tile.reset(key_x, key_y);
+      }
+      if (!tile.dirty)
+      {
+        tile.dirty = true;
+        dirty_slots_.push_back(slot);
+      }
+
+      const int cell = (cell_y - key_y * TILE_SIZE) * TILE_SIZE + (cell_x - key_x * TILE_SIZE);
+      tile.max_z[cell] = std::max(tile.max_z[cell], z);
+      tile.min_z[cell] = std::min(tile.min_z[cell], z);
+      tile.stamp[cell] = latest_stamp_;
+      tile.oldest_stamp = std::min(tile.oldest_stamp, latest_stamp_);
+    }
+
+    if (!dirty_slots_.empty())
+    {
+      sensor_msgs::PointCloud2 tiles_cloud;
+      tilesToCloud(dirty_slots_, cloud->header.stamp, tiles_cloud);
+      dirty_tiles_pub_.publish(tiles_cloud);
+      for (size_t i = 0; i < dirty_slots_.size(); i++)
+      {
+        tiles_[dirty_slots_[i]].dirty = false;
+      }
+      dirty_slots_.clear();
+    }
+  }
+
+  // Whole window, for subscribers that join late
+  void fullMapCallback(const ros::TimerEvent& event)
+  {
+    if (full_map_pub_.getNumSubscribers() == 0)
+    {
+      return;
+    }
+
+    const int min_key_x = center_key_x_ - num_tiles_ / 2;
+    const int min_key_y = center_key_y_ - num_tiles_ / 2;
+    std::vector<int> slots;
+    for (size_t slot = 0; slot < tiles_.size(); slot++)
+    {
+      if (inWindow(tiles_[slot], min_key_x, min_key_y))
+      {
+        slots.push_back(slot);
+      }
+    }
+
+    sensor_msgs::PointCloud2 map_cloud;
+    tilesToCloud(slots, event.current_real, map_cloud);
+    full_map_pub_.publish(map_cloud);
+  }
+
+  bool inWindow(const ElevationTile& tile, int min_key_x, int min_key_y) const
+  {
+    return tile.key_x >= min_key_x && tile.key_x < min_key_x + num_tiles_ && tile.key_y >= min_key_y && tile.key_y < min_key_y + num_tiles_;
+  }
+
+  // Whole tiles, TILE_CELLS points each in row-major order: cell center (x, y),
+  // max height (z), min height (min_z) and the key of the tile (key_x, key_y).
+  // Unknown cells have NaN heights, so a received tile fully replaces the
+  // previous version of the same key.
+  void tilesToCloud(const std::vector<int>& slots, const ros::Time& stamp, sensor_msgs::PointCloud2& cloud)
+  {
+    cloud.header.stamp = stamp;
+    cloud.header.frame_id = map_frame_;
+    cloud.height = 1;
+    sensor_msgs::PointCloud2Modifier modifier(cloud);
+    modifier.setPointCloud2Fields(6, "x", 1, sensor_msgs::PointField::FLOAT32,
+                                     "y", 1, sensor_msgs::PointField::FLOAT32,
+                                     "z", 1, sensor_msgs::PointField::FLOAT32,
+                                     "min_z", 1, sensor_msgs::PointField::FLOAT32,
+                                     "key_x", 1, sensor_msgs::PointField::INT32,
+                                     "key_y", 1, sensor_msgs::PointField::INT32);
+    modifier.resize(slots.size() * TILE_CELLS);
+    cloud.is_dense = false;
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    sensor_msgs::PointCloud2Iterator<float> iter_x(cloud, "x"), iter_y(cloud, "y"), iter_z(cloud, "z"), iter_min_z(cloud, "min_z");
+    sensor_msgs::PointCloud2Iterator<int32_t> iter_key_x(cloud, "key_x"), iter_key_y(cloud, "key_y");
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+      const ElevationTile& tile = tiles_[slots[i]];
+      for (int cell = 0; cell < TILE_CELLS; cell++)
+      {
+        const bool known = tile.max_z[cell] != -std::numeric_limits<float>::infinity();
+        *iter_x = (tile.key_x * TILE_SIZE + cell % TILE_SIZE + 0.5) * resolution_;
+        *iter_y = (tile.key_y * TILE_SIZE + cell / TILE_SIZE + 0.5) * resolution_;
+        *iter_z = known ? tile.max_z[cell] : nan;
+        *iter_min_z = known ? tile.min_z[cell] : nan;
+        *iter_key_x = tile.key_x;
+        *iter_key_y = tile.key_y;
+        ++iter_x; ++iter_y; ++iter_z; ++iter_min_z; ++iter_key_x; ++iter_key_y;
+      }
+    }
+  }
+};
+
+
+
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "elevation_grid_mapping");
+  ros::NodeHandle nh;
+  ros::NodeHandle priv_nh("~");
+
+  std::string cloud_topic, dirty_tiles_topic, full_map_topic, map_frame, robot_frame;
+  double resolution, max_point_height, full_map_period, cell_timeout;
+  int num_tiles;
+
+  priv_nh.param("cloud_topic", cloud_topic, std::string("sync_scan_cloud_filtered"));
+  priv_nh.param("dirty_tiles_topic", dirty_tiles_topic, std::string("spinning_lidar/elevation_tiles"));
+  priv_nh.param("full_map_topic", full_map_topic, std::string("spinning_lidar/elevation_map"));
+  priv_nh.param("map_frame", map_frame, std::string("odom"));
+  priv_nh.param("robot_frame", robot_frame, std::string("base_link"));
+  priv_nh.param("resolution", resolution, 0.1);
+  priv_nh.param("num_tiles", num_tiles, 16);
+  priv_nh.param("max_point_height", max_point_height, 2.0);
+  priv_nh.param("full_map_period", full_map_period, 1.0);
+  priv_nh.param("cell_timeout", cell_timeout, 10.0);
+
+  if (resolution <= 0.0 || num_tiles < 1)
+  {
+    ROS_ERROR("Invalid elevation grid size");
+    return EXIT_FAILURE;
+  }
+
+  ROS_INFO("Elevation grid of %.1f m at %.2f m/cell in '%s', published as '%s'", num_tiles * TILE_SIZE * resolution, resolution, map_frame.c_str(), dirty_tiles_topic.c_str());
+  ElevationGridMapper elevation_mapper(nh, cloud_topic, dirty_tiles_topic, full_map_topic, map_frame, robot_frame, resolution, num_tiles, max_point_height, full_map_period, cell_timeout);
+
+  ros::spin();
+
+  return EXIT_SUCCESS;
+}
@@ -1,28 +1,120 @@
 
 
+#include <deque>
+
+#include <boost/shared_ptr.hpp>
+
 #include <ros/ros.h>
 #include <laser_assembler/AssembleScans.h>
 #include <laser_assembler/AssembleScans2.h>
 #include <sensor_msgs/PointCloud.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <std_msgs/Empty.h>
+#include <tf/transform_listener.h>
+#include <tf/message_filter.h>
+#include <message_filters/subscriber.h>
+#include <pcl_ros/transforms.h>
+
+#include <spinning_lidar_utils/point_cloud_utils.h>
+#include <spinning_lidar_utils/sweep_log.h>
 
 
-std::string ir_interrupt_topic, assembled_cloud_topic, assemble_service;
+std::string ir_interrupt_topic, assembled_cloud_topic, assemble_service, sweep_log_path;
+std::string edge_cloud_topic, planar_cloud_topic, assembled_edge_cloud_topic, assembled_planar_cloud_topic, fixed_frame;
+boost::shared_ptr<tf::TransformListener> tf_listener;
 ros::ServiceClient assemble_client;
 laser_assembler::AssembleScans2 assemble_srv;
-ros::Publisher point_cloud_pub;
+ros::Publisher point_cloud_pub, edge_cloud_pub, planar_cloud_pub;
+std::deque<sensor_msgs::PointCloud2::ConstPtr> edge_scan_clouds, planar_scan_clouds;
 size_t num_points_thesh = 5000;
+size_t max_feature_scans = 400;  // same history as the laser_assembler
+spinning_lidar_utils::SweepLogWriter sweep_log;
+
+// Per-scan feature clouds are queued in the fixed frame of the laser_assembler,
+// at the stamp of their scan, so the feature sweeps line up with the assembled
+// sweep like its own scans do
+void queueFeatureCloud(const sensor_msgs::PointCloud2::ConstPtr& msg, std::deque<sensor_msgs::PointCloud2::ConstPtr>& scan_clouds)
+{
+  sensor_msgs::PointCloud2::Ptr cloud(new sensor_msgs::PointCloud2());
+  if (!pcl_ros::transformPointCloud(fixed_frame, *msg, *cloud, *tf_listener))
+  {
+    return;
+  }
+  scan_clouds.push_back(cloud);
+  if (scan_clouds.size() > max_feature_scans)
+  {
+    scan_clouds.pop_front();
+  }
+}
+
+void edgeCloudCallback(const sensor_msgs::PointCloud2::ConstPtr& msg)
+{
+  queueFeatureCloud(msg, edge_scan_clouds);
+}
+
+void planarCloudCallback(const sensor_msgs::PointCloud2::ConstPtr& msg)
+{
+  queueFeatureCloud(msg, planar_scan_clouds);
+}
+
+// Merges the feature clouds of the scans stamped in [begin, end], the same
+// window the laser_assembler used for the sweep. Scans before end are dropped.
+// Later ones are kept for the next sweep, and so is a scan stamped exactly at
+// end, since the next sweep begins there and the assembler includes it again.
+void assembleFeatureCloud(std::deque<sensor_msgs::PointCloud2::ConstPtr>& scan_clouds, const ros::Time& begin, const ros::Time& end,
+                          sensor_msgs::PointCloud2& sweep_cloud)
+{
+  std::deque<sensor_msgs::PointCloud2::ConstPtr>::iterator it = scan_clouds.begin();
+  while (it != scan_clouds.end())
+  {
+    const ros::Time& stamp = (*it)->header.stamp;
+    if (stamp > end)
+    {
+      ++it;
+      continue;
+    }
+    if (stamp >= begin)
+    {
+      spinning_lidar_utils::appendCloud(**it, sweep_cloud);
+    }
+    if (stamp == end)
+    {
+      ++it;
+    }
+    else
+    {
+      it = scan_clouds.erase(it);
+    }
+  }
+}
+
+void publishFeatureCloud(ros::Publisher& pub, std::deque<sensor_msgs::PointCloud2::ConstPtr>& scan_clouds, bool sweep_published)
+{
+  sensor_msgs::PointCloud2 sweep_cloud;
+  assembleFeatureCloud(scan_clouds, assemble_srv.request.begin, assemble_srv.request.end, sweep_cloud);
+  if (sweep_published && !sweep_cloud.data.empty())
+  {
+    sweep_cloud.header.stamp = assemble_srv.request.end;
+    sweep_cloud.header.frame_id = fixed_frame;
+    pub.publish(sweep_cloud);
+  }
+}
 
 void irInterruptCallback(const std_msgs::Empty::ConstPtr& msg)
 {
   assemble_srv.request.end = ros::Time::now();
+  bool sweep_published = false;
   if (assemble_client.call(assemble_srv))
   {
     if(assemble_srv.response.cloud.width > num_points_thesh)
     {
       // ROS_INFO("Got cloud with %i points", assemble_srv.response.cloud.width);
       point_cloud_pub.publish(assemble_srv.response.cloud);
+      sweep_published = true;
+      if (sweep_log.isOpen())
+      {
+        sweep_log.append(assemble_srv.response.cloud);
+      }
     }
   }
   else
@@ -30,6 +122,10 @@ void irInterruptCallback(const std_msgs::Empty::ConstPtr& msg)
     ROS_INFO("Service call failed");
   }
 
+  // Feature clouds are published only alongside the sweep, with the same stamp
+  publishFeatureCloud(edge_cloud_pub, edge_scan_clouds, sweep_published);
+  publishFeatureCloud(planar_cloud_pub, planar_scan_clouds, sweep_published);
+
   assemble_srv.request.begin = assemble_srv.request.end;
 }
 
@@ -38,18 +134,47 @@ int main(int argc, char** argv)
 {
   ros::init(argc, argv, "interrupt_laser_assembler");
   ros::NodeHandle nh;
+  ros::NodeHandle priv_nh("~");
 
   nh.param("ir_interrupt_topic", ir_interrupt_topic, std::string("spinning_lidar/ir_interrupt"));
   nh.param("assembled_cloud_topic", assembled_cloud_topic, std::string("spinning_lidar/assembled_cloud"));
   nh.param("assemble_service", assemble_service, std::string("assemble_scans2"));
+  priv_nh.param("sweep_log_path", sweep_log_path, std::string(""));
+  priv_nh.param("edge_cloud_topic", edge_cloud_topic, std::string("spinning_lidar/scan_edge_cloud"));
+  priv_nh.param("planar_cloud_topic", planar_cloud_topic, std::string("spinning_lidar/scan_planar_cloud"));
+  priv_nh.param("assembled_edge_cloud_topic", assembled_edge_cloud_topic, std::string("spinning_lidar/assembled_edge_cloud"));
+  priv_nh.param("assembled_planar_cloud_topic", assembled_planar_cloud_topic, std::string("spinning_lidar/assembled_planar_cloud"));
+  // Must match the fixed_frame of the laser_assembler
+  priv_nh.param("fixed_frame", fixed_frame, std::string("laser_mount"));
+
+  if (sweep_log_path.empty())
+  {
+    ROS_INFO("No ~sweep_log_path set, assembled sweeps are not logged");
+  }
+  else if (sweep_log.open(sweep_log_path))
+  {
+    ROS_INFO("Logging assembled sweeps to '%s'", sweep_log_path.c_str());
+  }
 
   point_cloud_pub = nh.advertise<sensor_msgs::PointCloud2>(assembled_cloud_topic, 1);
+  edge_cloud_pub = nh.advertise<sensor_msgs::PointCloud2>(assembled_edge_cloud_topic, 1);
+  planar_cloud_pub = nh.advertise<sensor_msgs::PointCloud2>(assembled_planar_cloud_topic, 1);
   ros::Subscriber ir_interrupt_sub = nh.subscribe(ir_interrupt_topic, 1, irInterruptCallback);
 
+  // Feature clouds are only delivered once they can be transformed into the fixed frame
+  tf_listener.reset(new tf::TransformListener());
+  message_filters::Subscriber<sensor_msgs::PointCloud2> edge_cloud_sub(nh, edge_cloud_topic, 100);
+  message_filters::Subscriber<sensor_msgs::PointCloud2> planar_cloud_sub(nh, planar_cloud_topic, 100);
+  tf::MessageFilter<sensor_msgs::PointCloud2> edge_cloud_filter(edge_cloud_sub, *tf_listener, fixed_frame, 100);
+  tf::MessageFilter<sensor_msgs::PointCloud2> planar_cloud_filter(planar_cloud_sub, *tf_listener, fixed_frame, 100);
+  edge_cloud_filter.registerCallback(edgeCloudCallback);
+  planar_cloud_filter.registerCallback(planarCloudCallback);
+
   ros::service::waitForService(assemble_service);
   assemble_client = nh.serviceClient<laser_assembler::AssembleScans2>(assemble_service);
     
   ros::spin();
+  sweep_log.close();
 
   return EXIT_SUCCESS;
 }
@@ -12,6 +12,9 @@
 #include <pcl/point_types.h>
 #include <pcl/filters/voxel_grid.h>
 
+#include <spinning_lidar_utils/scan_features.h>
+#include <spinning_lidar_utils/scan_filtering.h>
+
 
 class DynamicLaserToPointCloud
 {
@@ -33,50 +36,43 @@ public:
     filtered_scan_pub_ = nh_.advertise<sensor_msgs::LaserScan>(filtered_scan_topic, 1);
     filtered_cloud_pub_ = nh_.advertise<sensor_msgs::PointCloud2>(filtered_cloud_topic_, 1);
     min_dist_to_sensor_ = min_dist_to_sensor;
+    extract_features_ = false;
+  }
+
+  void enableFeatureExtraction(std::string edge_cloud_topic, std::string planar_cloud_topic, const spinning_lidar_utils::ScanFeatureParams& params)
+  {
+    feature_extractor_ = spinning_lidar_utils::ScanFeatureExtractor(params);
+    edge_cloud_pub_ = nh_.advertise<sensor_msgs::PointCloud2>(edge_cloud_topic, 10);
+    planar_cloud_pub_ = nh_.advertise<sensor_msgs::PointCloud2>(planar_cloud_topic, 10);
+    extract_features_ = true;
   }
 
 private:
   
-  ros::Publisher filtered_scan_pub_, filtered_cloud_pub_;
+  ros::Publisher filtered_scan_pub_, filtered_cloud_pub_, edge_cloud_pub_, planar_cloud_pub_;
   std::string laser_link_, laser_scan_topic_, filtered_scan_topic_, filtered_cloud_topic_;
   tf::TransformListener tf_listener_;
   tf::MessageFilter<sensor_msgs::LaserScan> tf_laser_filter_;
   laser_geometry::LaserProjection laser_projector_;
   double tf_filter_tol_ = 0.03;
   double min_dist_to_sensor_;
-  float inf = std::numeric_limits<float>::infinity();
+  bool extract_features_;
+  spinning_lidar_utils::ScanFeatureExtractor feature_extractor_;
+  std::vector<uint8_t> feature_labels_;
   
   void scanCallback(const sensor_msgs::LaserScan::ConstPtr& scan)
   {
     sensor_msgs::LaserScan filtered_scan; //create new LaserScan msg for filtered points
 
     // LIDAR scan filtering
-    // Reference: https://github.com/RobustFieldAutonomyLab/spin_hokuyo/blob/master/src/hokuyo_robot_filter.cpp
-    int num_range_meas = scan->ranges.size();
-    int num_int_meas = scan->intensities.size();
-    filtered_scan.header = scan->header;
-    filtered_scan.angle_min = scan->angle_min;
-    filtered_scan.angle_max = scan->angle_max;
-    filtered_scan.angle_increment = scan->angle_increment;
-    filtered_scan.time_increment = scan->time_increment;
-    filtered_scan.scan_time = scan->scan_time;
-    filtered_scan.range_min = 0;
-    filtered_scan.range_max = inf;
-    filtered_scan.intensities[num_int_meas];
-    filtered_scan.ranges.resize(num_range_meas);
-    for(int n=0; n<num_range_meas ;n++)
+    spinning_lidar_utils::filterScan(*scan, min_dist_to_sensor_, filtered_scan);
+    filtered_scan_pub_.publish(filtered_scan);
+
+    // Feature extraction needs the beam ordering, so it runs before projection
+    if (extract_features_)
     {
-      if (scan->ranges[n] > min_dist_to_sensor_)
-      { 
-        filtered_scan.ranges[n] = scan->ranges[n];
-      }
-      else
-      {
-        // Set range to inf to "remove" point if it is so close that it could be the laser platform
-        filtered_scan.ranges[n] = inf;
-      }
+      feature_extractor_.extract(filtered_scan, feature_labels_);
     }
-    filtered_scan_pub_.publish(filtered_scan);
 
     // Projection of laser scans into point clouds
     sensor_msgs::PointCloud2 cloud, cloud_mount;
@@ -93,6 +89,16 @@ private:
     cloud.header = scan->header;
     cloud.header.frame_id = laser_link_;
     filtered_cloud_pub_.publish(cloud);
+
+    if (extract_features_)
+    {
+      sensor_msgs::PointCloud2 edge_cloud, planar_cloud;
+      if (spinning_lidar_utils::ScanFeatureExtractor::splitCloud(cloud, feature_labels_, edge_cloud, planar_cloud))
+      {
+        edge_cloud_pub_.publish(edge_cloud);
+        planar_cloud_pub_.publish(planar_cloud);
+      }
+    }
   }
 };
 
@@ -107,8 +113,9 @@ int main(int argc, char** argv)
 
 
   double min_dist_to_sensor;
-  bool apply_voxel_filter;
-  std::string laser_scan_topic, filtered_scan_topic, filtered_cloud_topic, laser_link;
+  bool apply_voxel_filter, extract_features;
+  std::string laser_scan_topic, filtered_scan_topic, filtered_cloud_topic, laser_link, edge_cloud_topic, planar_cloud_topic;
+  spinning_lidar_utils::ScanFeatureParams feature_params;
 
   priv_nh.param("min_dist_to_sensor", min_dist_to_sensor, 0.5);
   priv_nh.param("laser_link", laser_link, std::string("laser"));
@@ -116,11 +123,34 @@ int main(int argc, char** argv)
   priv_nh.param("filtered_scan_topic", filtered_scan_topic, std::string("spinning_lidar/filtered_scan"));
   priv_nh.param("filtered_cloud_topic", filtered_cloud_topic, std::string("spinning_lidar/filtered_cloud"));
   priv_nh.param("apply_voxel_filter", apply_voxel_filter, false);
+  priv_nh.param("extract_features", extract_features, false);
+  priv_nh.param("edge_cloud_topic", edge_cloud_topic, std::string("spinning_lidar/scan_edge_cloud"));
+  priv_nh.param("planar_cloud_topic", planar_cloud_topic, std::string("spinning_lidar/scan_planar_cloud"));
+  priv_nh.param("curvature_window", feature_params.curvature_window, feature_params.curvature_window);
+  priv_nh.param("smoothing_window", feature_params.smoothing_window, feature_params.smoothing_window);
+  priv_nh.param("num_regions", feature_params.num_regions, feature_params.num_regions);
+  priv_nh.param("max_edges_per_region", feature_params.max_edges_per_region, feature_params.max_edges_per_region);
+  priv_nh.param("max_planars_per_region", feature_params.max_planars_per_region, feature_params.max_planars_per_region);
+  priv_nh.param("edge_threshold", feature_params.edge_threshold, feature_params.edge_threshold);
+  priv_nh.param("planar_threshold", feature_params.planar_threshold, feature_params.planar_threshold);
+  priv_nh.param("occlusion_ratio", feature_params.occlusion_ratio, feature_params.occlusion_ratio);
+
+  if (extract_features && (feature_params.curvature_window < 1 || feature_params.smoothing_window < 0 || feature_params.num_regions < 1 ||
+                           feature_params.max_edges_per_region < 0 || feature_params.max_planars_per_region < 0))
+  {
+    ROS_ERROR("Invalid feature parameters: curvature_window and num_regions must be at least 1, smoothing_window and the features per region can't be negative");
+    return EXIT_FAILURE;
+  }
 
   ros::Duration(2.0).sleep();
 
   ROS_INFO("Dynamic (using TF) filtering of laser scans");
   DynamicLaserToPointCloud laser_pcl_converter(nh, laser_scan_topic, laser_link, filtered_scan_topic, filtered_cloud_topic, min_dist_to_sensor);
+  if (extract_features)
+  {
+    ROS_INFO("Extracting edge/planar features per scan");
+    laser_pcl_converter.enableFeatureExtraction(edge_cloud_topic, planar_cloud_topic, feature_params);
+  }
     
   ros::spin();
 
@@ -0,0 +1,276 @@
+
+#include <cmath>
+#include <deque>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <ros/ros.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <std_msgs/Empty.h>
+#include <tf/transform_listener.h>
+#include <tf/message_filter.h>
+#include <message_filters/subscriber.h>
+#include <laser_geometry/laser_geometry.h>
+#include <pcl_ros/transforms.h>
+
+#include <spinning_lidar_utils/point_cloud_utils.h>
+#include <spinning_lidar_utils/scan_filtering.h>
+
+
+// One spinning lidar: filters and projects its scans into its own fixed frame,
+// and assembles them into a sweep every time its IR interrupt fires
+class LidarUnit
+{
+public:
+  typedef boost::function<void(const sensor_msgs::PointCloud2::ConstPtr&)> SweepCallback;
+
+  LidarUnit(ros::NodeHandle nh, ros::NodeHandle unit_nh, const std::string& name, tf::TransformListener& tf_listener, SweepCallback sweep_callback) :
+    nh_(nh),
+    name_(name),
+    tf_listener_(tf_listener),
+    sweep_callback_(sweep_callback)
+  {
+    unit_nh.param("laser_scan_topic", laser_scan_topic_, name + "/scan");
+    unit_nh.param("ir_interrupt_topic", ir_interrupt_topic_, name + "/ir_interrupt");
+    unit_nh.param("assembled_cloud_topic", assembled_cloud_topic_, name + "/assembled_cloud");
+    unit_nh.param("laser_link", laser_link_, name + "_mount_base_link");
+    unit_nh.param("min_dist_to_sensor", min_dist_to_sensor_, 0.5);
+    unit_nh.param("min_sweep_points", min_sweep_points_, 5000);
+    unit_nh.param("max_scans", max_scans_, 400);
+
+    laser_sub_.reset(new message_filters::Subscriber<sensor_msgs::LaserScan>(nh_, laser_scan_topic_, 10));
+    tf_laser_filter_.reset(new tf::MessageFilter<sensor_msgs::LaserScan>(*laser_sub_, tf_listener_, laser_link_, 10));
+    tf_laser_filter_->setTolerance(ros::Duration(tf_filter_tol_));
+    tf_laser_filter_->registerCallback( boost::bind(&LidarUnit::scanCallback, this, _1) );
+    ir_interrupt_sub_ = nh_.subscribe(ir_interrupt_topic_, 1, &LidarUnit::irInterruptCallback, this);
+    assembled_cloud_pub_ = nh_.advertise<sensor_msgs::PointCloud2>(assembled_cloud_topic_, 1);
+    sweep_begin_ = ros::Time::now();
+
+    ROS_INFO("Unit '%s': assembling '%s' in '%s' on '%s', published as '%s'", name_.c_str(), laser_scan_topic_.c_str(), laser_link_.c_str(), ir_interrupt_topic_.c_str(), assembled_cloud_topic_.c_str());
+  }
+
+  const std::string& name() const { return name_; }
+
+private:
+  ros::NodeHandle nh_;
+  std::string name_, laser_scan_topic_, ir_interrupt_topic_, assembled_cloud_topic_, laser_link_;
+  double min_dist_to_sensor_;
+  int min_sweep_points_;
+  int max_scans_;
+  double tf_filter_tol_ = 0.03;
+
+  // The TF listener is shared by all the units
+  tf::TransformListener& tf_listener_;
+  boost::shared_ptr<message_filters::Subscriber<sensor_msgs::LaserScan> > laser_sub_;
+  boost::shared_ptr<tf::MessageFilter<sensor_msgs::LaserScan> > tf_laser_filter_;
+  ros::Subscriber ir_interrupt_sub_;
+  ros::Publisher assembled_cloud_pub_;
+  laser_geometry::LaserProjection laser_projector_;
+  SweepCallback sweep_callback_;
+
+  // Scans of the current sweep sorted by stamp, guarded since callbacks run on
+  // a thread pool. Capped to max_scans_, like the laser_assembler history.
+  boost::mutex mutex_;
+  std::deque<sensor_msgs::PointCloud2> scan_clouds_;
+  ros::Time sweep_begin_;
+
+  void scanCallback(const sensor_msgs::LaserScan::ConstPtr& scan)
+  {
+    sensor_msgs::LaserScan filtered_scan;
+    spinning_lidar_utils::filterScan(*scan, min_dist_to_sensor_, filtered_scan);
+
+    sensor_msgs::PointCloud2 cloud;
+    try
+    {
+      laser_projector_.transformLaserScanToPointCloud(laser_link_, filtered_scan, cloud, tf_listener_);
+    }
+    catch (tf::TransformException& e)
+    {
+      ROS_DEBUG("Unit '%s': %s", name_.c_str(), e.what());
+      return;
+    }
+    cloud.header.stamp = scan->header.stamp;
+    cloud.header.frame_id = laser_link_;
+
+    boost::mutex::scoped_lock lock(mutex_);
+    // Workers can finish scans out of order, insert behind the last older one
+    std::deque<sensor_msgs::PointCloud2>::iterator it = scan_clouds_.end();
+    while (it != scan_clouds_.begin() && (it - 1)->header.stamp > cloud.header.stamp)
+    {
+      --it;
+    }
+    scan_clouds_.insert(it, cloud);
+    while (scan_clouds_.size() > static_cast<size_t>(max_scans_))
+    {
+      scan_clouds_.pop_front();
+    }
+  }
+
+  void irInterruptCallback(const std_msgs::Empty::ConstPtr& msg)
+  {
+    sensor_msgs::PointCloud2::Ptr sweep(new sensor_msgs::PointCloud2());
+    const ros::Time sweep_end = ros::Time::now();
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!scan_clouds_.empty() && scan_clouds_.front().header.stamp < sweep_end)
+      {
+        if (scan_clouds_.front().header.stamp >= sweep_begin_)
+        {
+          spinning_lidar_utils::appendCloud(scan_clouds_.front(), *sweep);
+        }
+        scan_clouds_.pop_front();
+      }
+      sweep_begin_ = sweep_end;
+    }
+
+    if (sweep->width > static_cast<uint32_t>(min_sweep_points_))
+    {
+      sweep->header.stamp = sweep_end;
+      sweep->header.frame_id = laser_link_;
+      assembled_cloud_pub_.publish(sweep);
+      sweep_callback_(sweep);
+    }
+  }
+};
+
+
+// Runs several spinning lidars in one process. All the units share the
+// callback thread pool and the TF buffer, and their sweeps can optionally be
+// fused into a common frame every time the first unit completes a sweep.
+class MultiLidarAssembler
+{
+public:
+  MultiLidarAssembler(ros::NodeHandle nh, ros::NodeHandle priv_nh, const std::vector<std::string>& unit_names, double tf_cache_time) :
+    nh_(nh),
+    tf_listener_(ros::Duration(tf_cache_time))
+  {
+    priv_nh.param("fuse_sweeps", fuse_sweeps_, false);
+    priv_nh.param("fused_frame", fused_frame_, std::string("base_link"));
+    priv_nh.param("fusion_fixed_frame", fusion_fixed_frame_, std::string("odom"));
+    priv_nh.param("fused_cloud_topic", fused_cloud_topic_, std::string("spinning_lidar/fused_cloud"));
+    priv_nh.param("fusion_max_dt", fusion_max_dt_, 0.5);
+
+    latest_sweeps_.resize(unit_names.size());
+    for (size_t i = 0; i < unit_names.size(); i++)
+    {
+      ros::NodeHandle unit_nh(priv_nh, unit_names[i]);
+      units_.push_back(boost::shared_ptr<LidarUnit>(new LidarUnit(nh_, unit_nh, unit_names[i], tf_listener_,
+        boost::bind(&MultiLidarAssembler::sweepCallback, this, i, _1))));
+    }
+
+    if (fuse_sweeps_)
+    {
+      fused_cloud_pub_ = nh_.advertise<sensor_msgs::PointCloud2>(fused_cloud_topic_, 1);
+      ROS_INFO("Fusing sweeps of %lu units in '%s' (through '%s'), published as '%s'", units_.size(), fused_frame_.c_str(), fusion_fixed_frame_.c_str(), fused_cloud_topic_.c_str());
+    }
+  }
+
+private:
+  ros::NodeHandle nh_;
+  tf::TransformListener tf_listener_;
+  std::vector<boost::shared_ptr<LidarUnit> > units_;
+
+  bool fuse_sweeps_;
+  std::string fused_frame_, fusion_fixed_frame_, fused_cloud_topic_;
+  double fusion_max_dt_;
+  ros::Publisher fused_cloud_pub_;
+  boost::mutex fusion_mutex_;
+  // Latest sweep of each unit not fused yet
+  std::vector<sensor_msgs::PointCloud2::ConstPtr> latest_sweeps_;
+
+  void sweepCallback(size_t unit_idx, const sensor_msgs::PointCloud2::ConstPtr& sweep)
+  {
+    if (!fuse_sweeps_)
+    {
+      return;
+    }
+
+    std::vector<sensor_msgs::PointCloud2::ConstPtr> sweeps;
+    {
+      boost::mutex::scoped_lock lock(fusion_mutex_);
+      latest_sweeps_[unit_idx] = sweep;
+      if (unit_idx != 0)
+      {
+        return;
+      }
+      // Every sweep is fused at most once
+      sweeps.swap(latest_sweeps_);
+      latest_sweeps_.resize(sweeps.size());
+    }
+
+    // Only fuse sweeps that are close enough in time to the reference unit's.
+    // Each one is brought to the reference stamp through the fixed frame, so
+    // the motion of the robot between the sweeps is compensated.
+    sensor_msgs::PointCloud2 fused_cloud;
+    for (size_t i = 0; i < sweeps.size(); i++)
+    {
+      if (!sweeps[i] || std::fabs((sweeps[i]->header.stamp - sweep->header.stamp).toSec()) > fusion_max_dt_)
+      {
+        continue;
+      }
+
+      sensor_msgs::PointCloud2 cloud;
+      tf::StampedTransform transform;
+      try
+      {
+        tf_listener_.waitForTransform(fused_frame_, sweep->header.stamp, sweeps[i]->header.frame_id, sweeps[i]->header.stamp,
+                                      fusion_fixed_frame_, ros::Duration(0.1));
+        tf_listener_.lookupTransform(fused_frame_, sweep->header.stamp, sweeps[i]->header.frame_id, sweeps[i]->header.stamp,
+                                     fusion_fixed_frame_, transform);
+      }
+      catch (tf::TransformException& e)
+      {
+        ROS_WARN("Could not transform sweep of unit '%s' to '%s': %s", units_[i]->name().c_str(), fused_frame_.c_str(), e.what());
+        continue;
+      }
+      pcl_ros::transformPointCloud(fused_frame_, transform, *sweeps[i], cloud);
+      if (!spinning_lidar_utils::appendCloud(cloud, fused_cloud))
+      {
+        ROS_WARN("Sweep of unit '%s' has a different point layout, not fused", units_[i]->name().c_str());
+      }
+    }
+
+    if (!fused_cloud.data.empty())
+    {
+      fused_cloud.header.stamp = sweep->header.stamp;
+      fused_cloud.header.frame_id = fused_frame_;
+      fused_cloud_pub_.publish(fused_cloud);
+    }
+  }
+};
+
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "multi_lidar_assembler");
+  ros::NodeHandle nh;
+  ros::NodeHandle priv_nh("~");
+
+  std::vector<std::string> unit_names;
+  int num_worker_threads;
+  double tf_cache_time;
+
+  priv_nh.getParam("units", unit_names);
+  priv_nh.param("num_worker_threads", num_worker_threads, 0);
+  priv_nh.param("tf_cache_time", tf_cache_time, 10.0);
+
+  if (unit_names.empty())
+  {
+    ROS_ERROR("No lidar units configured, set the '~units' parameter");
+    return EXIT_FAILURE;
+  }
+
+  ros::Duration(2.0).sleep();
+
+  MultiLidarAssembler assembler(nh, priv_nh, unit_names, tf_cache_time);
+
+  // A single pool of worker threads serves the callbacks of all the units
+  ros::AsyncSpinner spinner(num_worker_threads);
+  spinner.start();
+  ros::waitForShutdown();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,247 @@
+
+#include <spinning_lidar_utils/scan_features.h>
+#include <spinning_lidar_utils/point_cloud_utils.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace spinning_lidar_utils
+{
+
+ScanFeatureExtractor::ScanFeatureExtractor(const ScanFeatureParams& params) :
+  params_(params)
+{
+}
+
+void ScanFeatureExtractor::extract(const sensor_msgs::LaserScan& scan, std::vector<uint8_t>& labels)
+{
+  const int n = scan.ranges.size();
+  const int k = params_.curvature_window;
+  labels.assign(n, FEATURE_NONE);
+  // Without neighbours there is no curvature, and the loops below would index out of the scan
+  if (k < 1 || n < 2*k + 1)
+  {
+    return;
+  }
+
+  computeCurvature(scan);
+  markUnreliable(scan);
+
+  // Split the scan in regions and take the sharpest/flattest points of each,
+  // so features are spread over the whole field of view
+  const int usable = n - 2*k;
+  const float edge_threshold_sq = params_.edge_threshold * params_.edge_threshold;
+  const float planar_threshold_sq = params_.planar_threshold * params_.planar_threshold;
+  for (int region = 0; region < params_.num_regions; region++)
+  {
+    const int start = k + usable * region / params_.num_regions;
+    const int end = k + usable * (region + 1) / params_.num_regions;
+    if (end <= start)
+    {
+      continue;
+    }
+
+    order_.resize(end - start);
+    for (int i = start; i < end; i++)
+    {
+      order_[i - start] = i;
+    }
+    std::sort(order_.begin(), order_.end(), [this](int a, int b) { return curvature_[a] < curvature_[b]; });
+
+    int num_edges = 0;
+    for (int j = order_.size() - 1; j >= 0 && num_edges < params_.max_edges_per_region; j--)
+    {
+      const int i = order_[j];
+      if (curvature_[i] <= edge_threshold_sq)
+      {
+        break;
+      }
+      if (!picked_[i])
+      {
+        labels[i] = FEATURE_EDGE;
+        num_edges++;
+        pickNeighbours(i, n);
+      }
+    }
+
+    int num_planars = 0;
+    for (size_t j = 0; j < order_.size() && num_planars < params_.max_planars_per_region; j++)
+    {
+      const int i = order_[j];
+      if (curvature_[i] >= planar_threshold_sq)
+      {
+        break;
+      }
+      if (!picked_[i])
+      {
+        labels[i] = FEATURE_PLANAR;
+        num_planars++;
+        pickNeighbours(i, n);
+      }
+    }
+  }
+}
+
+void ScanFeatureExtractor::computeCurvature(const sensor_msgs::LaserScan& scan)
+{
+  const int n = scan.ranges.size();
+  const int k = params_.curvature_window;
+  x_.resize(n);
+  y_.resize(n);
+  range_sq_.resize(n);
+  sum_x_.resize(n);
+  sum_y_.resize(n);
+  curvature_.assign(n, 0.0f);
+  valid_.resize(n);
+
+  for (int i = 0; i < n; i++)
+  {
+    const float r = scan.ranges[i];
+    const float angle = scan.angle_min + i * scan.angle_increment;
+    valid_[i] = std::isfinite(r) && r >= scan.range_min && r <= scan.range_max;
+    x_[i] = valid_[i] ? r * std::cos(angle) : 0.0f;
+    y_[i] = valid_[i] ? r * std::sin(angle) : 0.0f;
+    range_sq_[i] = valid_[i] ? r * r : 1.0f;
+  }
+
+  // Sum of the differences between the 2k neighbours and the point. The point
+  // is replaced by the mean of the 2m+1 beams around it: its own range noise is
+  // multiplied by 2k and would otherwise dominate the curvature.
+  // sum_i = sum_o w(o) X_{i+o}, with w(o) = [0 < |o| <= k] - 2k/(2m+1) [|o| <= m].
+  // The loops run over contiguous float arrays without branches, so they
+  // auto-vectorize.
+  const int m = std::min(std::max(params_.smoothing_window, 0), k);
+  const float two_k = 2.0f * k;
+  const float center_weight = two_k / (2*m + 1);
+  std::fill(sum_x_.begin(), sum_x_.end(), 0.0f);
+  std::fill(sum_y_.begin(), sum_y_.end(), 0.0f);
+  for (int offset = -k; offset <= k; offset++)
+  {
+    const float w = ((offset != 0) ? 1.0f : 0.0f) - ((std::abs(offset) <= m) ? center_weight : 0.0f);
+    const float* x = &x_[k + offset];
+    const float* y = &y_[k + offset];
+    float* sum_x = &sum_x_[k];
+    float* sum_y = &sum_y_[k];
+    for (int i = 0; i < n - 2*k; i++)
+    {
+      sum_x[i] += w * x[i];
+      sum_y[i] += w * y[i];
+    }
+  }
+  // LOAM normalization, |sum(X_j - X_i)| / (2k |X_i|). It is kept squared, so
+  // no square root is needed; thresholds are squared when comparing.
+  const float norm = 1.0f / (two_k * two_k);
+  for (int i = k; i < n - k; i++)
+  {
+    curvature_[i] = (sum_x_[i]*sum_x_[i] + sum_y_[i]*sum_y_[i]) * norm / range_sq_[i];
+  }
+}
+
+void ScanFeatureExtractor::markUnreliable(const sensor_msgs::LaserScan& scan)
+{
+  const int n = scan.ranges.size();
+  const int k = params_.curvature_window;
+  const float ratio = params_.occlusion_ratio;
+  picked_.assign(n, 1);
+
+  // Only points with a full window of valid neighbours can be features
+  int invalid_in_window = 0;
+  for (int i = 0; i < 2*k + 1; i++)
+  {
+    invalid_in_window += !valid_[i];
+  }
+  for (int i = k; i < n - k; i++)
+  {
+    picked_[i] = invalid_in_window > 0;
+    if (i + k + 1 < n)
+    {
+      invalid_in_window += !valid_[i + k + 1] - !valid_[i - k];
+    }
+  }
+
+  for (int i = k; i < n - k - 1; i++)
+  {
+    const float r = scan.ranges[i];
+    const float r_next = scan.ranges[i + 1];
+    const float r_prev = scan.ranges[i - 1];
+    if (!valid_[i] || !valid_[i + 1])
+    {
+      continue;
+    }
+
+    // Points on the far side of a depth discontinuity may be occluded
+    if (r > r_next * (1.0f + ratio))
+    {
+      std::fill(picked_.begin() + std::max(i - k + 1, 0), picked_.begin() + i + 1, 1);
+    }
+    else if (r_next > r * (1.0f + ratio))
+    {
+      std::fill(picked_.begin() + i + 1, picked_.begin() + std::min(i + k + 1, n), 1);
+    }
+
+    // Surfaces almost parallel to the beam
+    if (valid_[i - 1] && std::fabs(r - r_prev) > ratio * r && std::fabs(r - r_next) > ratio * r)
+    {
+      picked_[i] = 1;
+    }
+  }
+}
+
+void ScanFeatureExtractor::pickNeighbours(int i, int n)
+{
+  const int k = params_.curvature_window;
+  std::fill(picked_.begin() + std::max(i - k, 0), picked_.begin() + std::min(i + k + 1, n), 1);
+}
+
+bool ScanFeatureExtractor::splitCloud(const sensor_msgs::PointCloud2& cloud, const std::vector<uint8_t>& labels,
+                                      sensor_msgs::PointCloud2& edge_cloud, sensor_msgs::PointCloud2& planar_cloud)
+{
+  int index_offset = -1;
+  uint8_t index_datatype = 0;
+  for (size_t f = 0; f < cloud.fields.size(); f++)
+  {
+    if (cloud.fields[f].name == "index")
+    {
+      index_offset = cloud.fields[f].offset;
+      index_datatype = cloud.fields[f].datatype;
+    }
+  }
+  if (cloud.point_step == 0 || index_offset < 0 || (index_datatype != sensor_msgs::PointField::INT32 && index_datatype != sensor_msgs::PointField::FLOAT32))
+  {
+    return false;
+  }
+
+  // Label of each point, from the label of the beam it was projected from
+  const size_t num_points = static_cast<size_t>(cloud.width) * cloud.height;
+  std::vector<uint8_t> point_labels(num_points, FEATURE_NONE);
+  for (size_t p = 0; p < num_points; p++)
+  {
+    const uint8_t* point = &cloud.data[p * cloud.point_step];
+    int index;
+    if (index_datatype == sensor_msgs::PointField::INT32)
+    {
+      int32_t value;
+      memcpy(&value, point + index_offset, sizeof(value));
+      index = value;
+    }
+    else
+    {
+      float value;
+      memcpy(&value, point + index_offset, sizeof(value));
+      index = static_cast<int>(value);
+    }
+    if (index >= 0 && index < static_cast<int>(labels.size()))
+    {
+      point_labels[p] = labels[index];
+    }
+  }
+
+  sensor_msgs::PointCloud2* outputs[3] = {NULL, &edge_cloud, &planar_cloud};
+  splitCloudByLabel(cloud, point_labels, outputs, 3);
+  return true;
+}
+
+}  // namespace spinning_lidar_utils
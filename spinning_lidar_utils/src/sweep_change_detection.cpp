@@ -0,0 +1,319 @@
+
+#include <cmath>
+#include <deque>
+#include <limits>
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
+#include <tf/transform_listener.h>
+
+#include <spinning_lidar_utils/point_cloud_utils.h>
+
+
+// Branch-free atan2 approximation (max error ~2e-4 rad), so the loops using it
+// can be vectorized by the compiler
+inline float fastAtan2(float y, float x)
+{
+  const float ax = std::fabs(x);
+  const float ay = std::fabs(y);
+  const float a = std::min(ax, ay) / (std::max(ax, ay) + 1e-12f);
+  const float s = a * a;
+  float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+  r = (ay > ax) ? 1.57079637f - r : r;
+  r = (x < 0.0f) ? 3.14159274f - r : r;
+  return (y < 0.0f) ? -r : r;
+}
+
+
+// Flags the points of an assembled sweep that lie in front of surfaces seen by
+// the previous sweeps. Sweeps are rasterized into (scan angle x beam angle)
+// range grids around the spin axis, so every point is checked in constant time.
+class SweepChangeDetector
+{
+public:
+  ros::NodeHandle nh_;
+  ros::Subscriber assembled_cloud_sub_;
+
+  SweepChangeDetector(ros::NodeHandle nh, std::string assembled_cloud_topic, std::string static_cloud_topic, std::string dynamic_cloud_topic,
+                      std::string fixed_frame, int spin_axis, int num_angle_bins, int num_beam_bins, int history_size,
+                      double min_range_diff, double rel_range_diff) :
+    nh_(nh),
+    fixed_frame_(fixed_frame),
+    spin_axis_(spin_axis),
+    num_angle_bins_(num_angle_bins),
+    num_beam_bins_(num_beam_bins),
+    history_size_(history_size),
+    min_range_diff_(min_range_diff),
+    rel_range_diff_(rel_range_diff)
+  {
+    assembled_cloud_sub_ = nh_.subscribe(assembled_cloud_topic, 1, &SweepChangeDetector::cloudCallback, this);
+    static_cloud_pub_ = nh_.advertise<sensor_msgs::PointCloud2>(static_cloud_topic, 1);
+    dynamic_cloud_pub_ = nh_.advertise<sensor_msgs::PointCloud2>(dynamic_cloud_topic, 1);
+    grid_.resize(num_angle_bins_ * num_beam_bins_);
+    eroded_grid_.resize(grid_.size());
+    reference_grid_.resize(grid_.size());
+  }
+
+private:
+  // A previous sweep. With motion compensation its points are kept in the
+  // fixed frame and re-projected for every new sweep. Without it the sensor
+  // frame never moves, so only its eroded range grid is kept.
+  struct SweepPoints
+  {
+    std::vector<float> x, y, z;  // in the fixed frame
+    std::vector<float> eroded_grid;
+  };
+
+  ros::Publisher static_cloud_pub_, dynamic_cloud_pub_;
+  tf::TransformListener tf_listener_;
+  std::string fixed_frame_;
+  int spin_axis_;
+  int num_angle_bins_, num_beam_bins_;
+  int history_size_;
+  double min_range_diff_, rel_range_diff_;
+  float inf = std::numeric_limits<float>::infinity();
+
+  std::deque<SweepPoints> history_;
+  // Buffers reused between sweeps
+  std::vector<float> x_, y_, z_, px_, py_, pz_, range_;
+  std::vector<int> cell_;
+  std::vector<float> grid_, eroded_grid_, reference_grid_;
+  std::vector<uint8_t> dynamic_;
+
+  void cloudCallback(const sensor_msgs::PointCloud2::ConstPtr& cloud)
+  {
+    const size_t num_points = static_cast<size_t>(cloud->width) * cloud->height;
+    if (num_points == 0)
+    {
+      return;
+    }
+
+    // Pose of the sensor in the fixed frame, to compensate the motion between sweeps
+    tf::StampedTransform sensor_pose;
+    sensor_pose.setIdentity();
+    if (!fixed_frame_.empty())
+    {
+      try
+      {
+        tf_listener_.waitForTransform(fixed_frame_, cloud->header.frame_id, cloud->header.stamp, ros::Duration(0.2));
+        tf_listener_.lookupTransform(fixed_frame_, cloud->header.frame_id, cloud->header.stamp, sensor_pose);
+      }
+      catch (tf::TransformException& e)
+      {
+        ROS_WARN("%s", e.what());
+        return;
+      }
+    }
+
+    // Points of the sweep, as structure of arrays in the sensor frame
+    x_.resize(num_points);
+    y_.resize(num_points);
+    z_.resize(num_points);
+    sensor_msgs::PointCloud2ConstIterator<float> iter_x(*cloud, "x"), iter_y(*cloud, "y"), iter_z(*cloud, "z");
+    for (size_t i = 0; i < num_points; ++i, ++iter_x, ++iter_y, ++iter_z)
+    {
+      x_[i] = *iter_x;
+      y_[i] = *iter_y;
+      z_[i] = *iter_z;
+    }
+
+    // Previous sweeps, re-projected into the current sensor frame
+    const tf::Transform fixed_to_current_sensor = sensor_pose.inverse();
+    std::fill(reference_grid_.begin(), reference_grid_.end(), 0.0f);
+    for (size_t h = 0; h < history_.size(); h++)
+    {
+      const SweepPoints& prev = history_[h];
+      const float* prev_grid = prev.eroded_grid.data();
+      if (!fixed_frame_.empty())
+      {
+        transformPoints(fixed_to_current_sensor, prev.x, prev.y, prev.z, px_, py_, pz_);
+        computeCells(px_, py_, pz_);
+        rasterize();
+        erodeGrid();
+        prev_grid = eroded_grid_.data();
+      }
+      // A point is dynamic if it is in front of the surface seen by any previous sweep
+      for (size_t c = 0; c < reference_grid_.size(); c++)
+      {
+        reference_grid_[c] = std::max(reference_grid_[c], prev_grid[c]);
+      }
+    }
+
+    // Constant time per point: one lookup in the reference grid
+    computeCells(x_, y_, z_);
+    dynamic_.resize(num_points);
+    const float min_diff = min_range_diff_;
+    const float rel_diff = rel_range_diff_;
+    for (size_t i = 0; i < num_points; i++)
+    {
+      const float r = range_[i];
+      dynamic_[i] = r < reference_grid_[cell_[i]] - (min_diff + rel_diff * r);
+    }
+    publishSplit(*cloud);
+
+    // Store the current sweep for the next ones
+    history_.push_back(SweepPoints());
+    if (fixed_frame_.empty())
+    {
+      // cell_ and range_ still hold the current sweep
+      rasterize();
+      erodeGrid();
+      history_.back().eroded_grid = eroded_grid_;
+    }
+    else
+    {
+      transformPoints(sensor_pose, x_, y_, z_, history_.back().x, history_.back().y, history_.back().z);
+    }
+    while (static_cast<int>(history_.size()) > history_size_)
+    {
+      history_.pop_front();
+    }
+  }
+
+  void transformPoints(const tf::Transform& transform, const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z,
+                       std::vector<float>& out_x, std::vector<float>& out_y, std::vector<float>& out_z)
+  {
+    const tf::Matrix3x3& R = transform.getBasis();
+    const tf::Vector3& t = transform.getOrigin();
+    const float r00 = R[0][0], r01 = R[0][1], r02 = R[0][2];
+    const float r10 = R[1][0], r11 = R[1][1], r12 = R[1][2];
+    const float r20 = R[2][0], r21 = R[2][1], r22 = R[2][2];
+    const float tx = t.x(), ty = t.y(), tz = t.z();
+    const size_t n = x.size();
+    out_x.resize(n);
+    out_y.resize(n);
+    out_z.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+      out_x[i] = r00 * x[i] + r01 * y[i] + r02 * z[i] + tx;
+      out_y[i] = r10 * x[i] + r11 * y[i] + r12 * z[i] + ty;
+      out_z[i] = r20 * x[i] + r21 * y[i] + r22 * z[i] + tz;
+    }
+  }
+
+  // Range and grid cell of each point. The scan angle is measured around the
+  // spin axis and the beam angle from it.
+  void computeCells(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& z)
+  {
+    const size_t n = x.size();
+    const float* axial = (spin_axis_ == 0) ? x.data() : (spin_axis_ == 1) ? y.data() : z.data();
+    const float* u = (spin_axis_ == 0) ? y.data() : (spin_axis_ == 1) ? z.data() : x.data();
+    const float* v = (spin_axis_ == 0) ? z.data() : (spin_axis_ == 1) ? x.data() : y.data();
+    const float angle_scale = num_angle_bins_ / (2.0f * M_PI);
+    const float beam_scale = num_beam_bins_ / M_PI;
+    const int max_angle_bin = num_angle_bins_ - 1;
+    const int max_beam_bin = num_beam_bins_ - 1;
+    range_.resize(n);
+    cell_.resize(n);
+    for (size_t i = 0; i < n; i++)
+    {
+      const float radial = std::sqrt(u[i] * u[i] + v[i] * v[i]);
+      range_[i] = std::sqrt(radial * radial + axial[i] * axial[i]);
+      const int angle_bin = std::min(static_cast<int>((fastAtan2(v[i], u[i]) + static_cast<float>(M_PI)) * angle_scale), max_angle_bin);
+      const int beam_bin = std::min(static_cast<int>(fastAtan2(radial, axial[i]) * beam_scale), max_beam_bin);
+      cell_[i] = std::max(beam_bin, 0) * num_angle_bins_ + std::max(angle_bin, 0);
+    }
+  }
+
+  // Closest range seen in each cell, inf where there are no returns
+  void rasterize()
+  {
+    std::fill(grid_.begin(), grid_.end(), inf);
+    for (size_t i = 0; i < cell_.size(); i++)
+    {
+      grid_[cell_[i]] = std::min(grid_[cell_[i]], range_[i]);
+    }
+  }
+
+  // Minimum over the 3x3 neighbourhood of each cell (scan angle wraps around),
+  // so points near depth edges aren't flagged because of small misalignments.
+  // Cells without returns are unknown (0) and never make a point dynamic.
+  void erodeGrid()
+  {
+    const int cols = num_angle_bins_;
+    for (int row = 0; row < num_beam_bins_; row++)
+    {
+      const int row_begin = std::max(row - 1, 0);
+      const int row_end = std::min(row + 1, num_beam_bins_ - 1);
+      float* eroded = &eroded_grid_[row * cols];
+      for (int col = 0; col < cols; col++)
+      {
+        eroded[col] = inf;
+      }
+      for (int r = row_begin; r <= row_end; r++)
+      {
+        const float* g = &grid_[r * cols];
+        eroded[0] = std::min(eroded[0], std::min(std::min(g[cols - 1], g[0]), g[1]));
+        for (int col = 1; col < cols - 1; col++)
+        {
+          eroded[col] = std::min(eroded[col], std::min(std::min(g[col - 1], g[col]), g[col + 1]));
+        }
+        eroded[cols - 1] = std::min(eroded[cols - 1], std::min(std::min(g[cols - 2], g[cols - 1]), g[0]));
+      }
+      for (int col = 0; col < cols; col++)
+      {
+        eroded[col] = (eroded[col] == inf) ? 0.0f : eroded[col];
+      }
+    }
+  }
+
+  void publishSplit(const sensor_msgs::PointCloud2& cloud)
+  {
+    // dynamic_ holds 0 (static) or 1 (dynamic) per point
+    sensor_msgs::PointCloud2 static_cloud, dynamic_cloud;
+    sensor_msgs::PointCloud2* outputs[2] = {&static_cloud, &dynamic_cloud};
+    spinning_lidar_utils::splitCloudByLabel(cloud, dynamic_, outputs, 2);
+    static_cloud_pub_.publish(static_cloud);
+    dynamic_cloud_pub_.publish(dynamic_cloud);
+  }
+};
+
+
+
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "sweep_change_detection");
+  ros::NodeHandle nh;
+  ros::NodeHandle priv_nh("~");
+
+  std::string assembled_cloud_topic, static_cloud_topic, dynamic_cloud_topic, fixed_frame, spin_axis;
+  int num_angle_bins, num_beam_bins, history_size;
+  double min_range_diff, rel_range_diff;
+
+  priv_nh.param("assembled_cloud_topic", assembled_cloud_topic, std::string("spinning_lidar/assembled_cloud"));
+  priv_nh.param("static_cloud_topic", static_cloud_topic, std::string("spinning_lidar/static_cloud"));
+  priv_nh.param("dynamic_cloud_topic", dynamic_cloud_topic, std::string("spinning_lidar/dynamic_cloud"));
+  priv_nh.param("fixed_frame", fixed_frame, std::string(""));
+  priv_nh.param("spin_axis", spin_axis, std::string("x"));
+  priv_nh.param("num_angle_bins", num_angle_bins, 720);
+  priv_nh.param("num_beam_bins", num_beam_bins, 720);
+  priv_nh.param("history_size", history_size, 2);
+  priv_nh.param("min_range_diff", min_range_diff, 0.3);
+  priv_nh.param("rel_range_diff", rel_range_diff, 0.05);
+
+  if (spin_axis != "x" && spin_axis != "y" && spin_axis != "z")
+  {
+    ROS_ERROR("Invalid spin_axis '%s', it must be x, y or z", spin_axis.c_str());
+    return EXIT_FAILURE;
+  }
+  if (num_angle_bins < 3 || num_beam_bins < 1)
+  {
+    ROS_ERROR("The range grid needs at least 3 scan angle bins and 1 beam bin");
+    return EXIT_FAILURE;
+  }
+  if (history_size < 1)
+  {
+    ROS_ERROR("Invalid history_size %d, at least 1 previous sweep is needed", history_size);
+    return EXIT_FAILURE;
+  }
+
+  ROS_INFO("Detecting changes between consecutive sweeps on '%s'", assembled_cloud_topic.c_str());
+  SweepChangeDetector change_detector(nh, assembled_cloud_topic, static_cloud_topic, dynamic_cloud_topic, fixed_frame,
+                                      spin_axis[0] - 'x', num_angle_bins, num_beam_bins, history_size, min_range_diff, rel_range_diff);
+
+  ros::spin();
+
+  return EXIT_SUCCESS;
+}
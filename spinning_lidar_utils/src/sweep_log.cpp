@@ -0,0 +1,396 @@
+
+#include <spinning_lidar_utils/sweep_log.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ros/console.h>
+
+
+namespace spinning_lidar_utils
+{
+
+static size_t alignUp(size_t size)
+{
+  return (size + SWEEP_LOG_ALIGNMENT - 1) & ~(SWEEP_LOG_ALIGNMENT - 1);
+}
+
+static uint64_t toNSec(const ros::Time& t)
+{
+  return static_cast<uint64_t>(t.sec) * 1000000000ull + t.nsec;
+}
+
+static ros::Time fromNSec(uint64_t ns)
+{
+  ros::Time t;
+  t.fromNSec(ns);
+  return t;
+}
+
+
+ros::Time SweepView::stamp() const
+{
+  return fromNSec(header->stamp_ns);
+}
+
+std::string SweepView::frameId() const
+{
+  return std::string(frame_id, header->frame_id_len);
+}
+
+int SweepView::fieldOffset(const std::string& name) const
+{
+  for (uint32_t i = 0; i < header->num_fields; i++)
+  {
+    if (strncmp(fields[i].name, name.c_str(), SWEEP_LOG_FIELD_NAME_LEN) == 0)
+    {
+      return fields[i].offset;
+    }
+  }
+  return -1;
+}
+
+
+SweepLogWriter::SweepLogWriter() :
+  file_(NULL),
+  offset_(0),
+  failed_(false)
+{
+}
+
+SweepLogWriter::~SweepLogWriter()
+{
+  close();
+}
+
+bool SweepLogWriter::open(const std::string& path)
+{
+  close();
+  // "x": never overwrite an existing recording
+  file_ = fopen(path.c_str(), "wbx");
+  if (file_ == NULL)
+  {
+    if (errno == EEXIST)
+    {
+      ROS_ERROR("Sweep log '%s' already exists, not overwriting it", path.c_str());
+    }
+    else
+    {
+      ROS_ERROR("Could not open sweep log '%s' for writing", path.c_str());
+    }
+    return false;
+  }
+
+  SweepLogFileHeader file_header;
+  memset(&file_header, 0, sizeof(file_header));
+  memcpy(file_header.magic, SWEEP_LOG_MAGIC, sizeof(SWEEP_LOG_MAGIC));
+  file_header.version = SWEEP_LOG_VERSION;
+  offset_ = 0;
+  failed_ = false;
+  index_.clear();
+  if (!writeBlock(&file_header, sizeof(file_header)) || !writePadding())
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool SweepLogWriter::append(const sensor_msgs::PointCloud2& cloud)
+{
+  if (file_ == NULL || failed_)
+  {
+    return false;
+  }
+
+  const size_t data_size = cloud.data.size();
+  const size_t frame_id_len = std::min<size_t>(cloud.header.frame_id.size(), UINT16_MAX);
+  const size_t meta_size = sizeof(SweepChunkHeader) + cloud.fields.size() * sizeof(SweepLogField) + frame_id_len;
+
+  SweepChunkHeader chunk;
+  memset(&chunk, 0, sizeof(chunk));
+  chunk.magic = SWEEP_CHUNK_MAGIC;
+  chunk.num_fields = cloud.fields.size();
+  chunk.stamp_ns = toNSec(cloud.header.stamp);
+  chunk.width = cloud.width;
+  chunk.height = cloud.height;
+  chunk.point_step = cloud.point_step;
+  chunk.row_step = cloud.row_step;
+  chunk.is_bigendian = cloud.is_bigendian;
+  chunk.is_dense = cloud.is_dense;
+  chunk.frame_id_len = frame_id_len;
+  chunk.data_offset = alignUp(meta_size);
+  chunk.data_size = data_size;
+  chunk.chunk_size = alignUp(chunk.data_offset + data_size);
+
+  SweepLogIndexEntry entry;
+  entry.stamp_ns = chunk.stamp_ns;
+  entry.offset = offset_;
+
+  bool ok = writeBlock(&chunk, sizeof(chunk));
+  for (size_t i = 0; ok && i < cloud.fields.size(); i++)
+  {
+    SweepLogField field;
+    memset(&field, 0, sizeof(field));
+    strncpy(field.name, cloud.fields[i].name.c_str(), SWEEP_LOG_FIELD_NAME_LEN - 1);
+    field.offset = cloud.fields[i].offset;
+    field.count = cloud.fields[i].count;
+    field.datatype = cloud.fields[i].datatype;
+    ok = writeBlock(&field, sizeof(field));
+  }
+  ok = ok && writeBlock(cloud.header.frame_id.data(), frame_id_len) && writePadding();
+  ok = ok && writeBlock(cloud.data.data(), data_size) && writePadding();
+  if (!ok)
+  {
+    // The file position no longer matches offset_, so nothing else can be appended
+    ROS_ERROR("Failed to append sweep to log, no more sweeps will be logged");
+    failed_ = true;
+    return false;
+  }
+
+  index_.push_back(entry);
+  return true;
+}
+
+void SweepLogWriter::close()
+{
+  if (file_ == NULL)
+  {
+    return;
+  }
+
+  // After a failed write the tail of the file is garbage. Leave the index out,
+  // readers rebuild it from the chunks that were written completely.
+  if (failed_)
+  {
+    fclose(file_);
+    file_ = NULL;
+    return;
+  }
+
+  // Write the index, then patch the header so readers can find it
+  SweepLogFileHeader file_header;
+  memset(&file_header, 0, sizeof(file_header));
+  memcpy(file_header.magic, SWEEP_LOG_MAGIC, sizeof(SWEEP_LOG_MAGIC));
+  file_header.version = SWEEP_LOG_VERSION;
+  file_header.num_sweeps = index_.size();
+  file_header.index_offset = offset_;
+  if (writeBlock(index_.data(), index_.size() * sizeof(SweepLogIndexEntry)) && fseek(file_, 0, SEEK_SET) == 0)
+  {
+    fwrite(&file_header, sizeof(file_header), 1, file_);
+  }
+
+  fclose(file_);
+  file_ = NULL;
+}
+
+bool SweepLogWriter::writeBlock(const void* data, size_t size)
+{
+  if (size > 0 && fwrite(data, 1, size, file_) != size)
+  {
+    failed_ = true;
+    return false;
+  }
+  offset_ += size;
+  return true;
+}
+
+bool SweepLogWriter::writePadding()
+{
+  static const uint8_t zeros[SWEEP_LOG_ALIGNMENT] = {0};
+  return writeBlock(zeros, alignUp(offset_) - offset_);
+}
+
+
+SweepLogReader::SweepLogReader() :
+  fd_(-1),
+  map_(NULL),
+  map_size_(0)
+{
+}
+
+SweepLogReader::~SweepLogReader()
+{
+  close();
+}
+
+bool SweepLogReader::open(const std::string& path)
+{
+  close();
+  fd_ = ::open(path.c_str(), O_RDONLY);
+  if (fd_ < 0)
+  {
+    ROS_ERROR("Could not open sweep log '%s'", path.c_str());
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SweepLogFileHeader))
+  {
+    ROS_ERROR("Sweep log '%s' is too small", path.c_str());
+    close();
+    return false;
+  }
+  map_size_ = st.st_size;
+
+  void* map = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED)
+  {
+    ROS_ERROR("Could not mmap sweep log '%s'", path.c_str());
+    close();
+    return false;
+  }
+  map_ = static_cast<const uint8_t*>(map);
+
+  const SweepLogFileHeader* file_header = reinterpret_cast<const SweepLogFileHeader*>(map_);
+  if (memcmp(file_header->magic, SWEEP_LOG_MAGIC, sizeof(SWEEP_LOG_MAGIC)) != 0 || file_header->version != SWEEP_LOG_VERSION)
+  {
+    ROS_ERROR("'%s' is not a sweep log (or has an unsupported version)", path.c_str());
+    close();
+    return false;
+  }
+
+  if (!loadIndex(*file_header))
+  {
+    ROS_WARN("Sweep log '%s' has no valid index, rebuilding it", path.c_str());
+    if (!rebuildIndex())
+    {
+      close();
+      return false;
+    }
+  }
+  return true;
+}
+
+void SweepLogReader::close()
+{
+  if (map_ != NULL)
+  {
+    munmap(const_cast<uint8_t*>(map_), map_size_);
+    map_ = NULL;
+  }
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  map_size_ = 0;
+  index_.clear();
+}
+
+ros::Time SweepLogReader::stamp(size_t i) const
+{
+  return fromNSec(index_[i].stamp_ns);
+}
+
+SweepView SweepLogReader::sweep(size_t i) const
+{
+  const uint8_t* chunk = map_ + index_[i].offset;
+  SweepView view;
+  view.header = reinterpret_cast<const SweepChunkHeader*>(chunk);
+  view.fields = reinterpret_cast<const SweepLogField*>(chunk + sizeof(SweepChunkHeader));
+  view.frame_id = reinterpret_cast<const char*>(view.fields + view.header->num_fields);
+  view.data = chunk + view.header->data_offset;
+  return view;
+}
+
+size_t SweepLogReader::seek(const ros::Time& t) const
+{
+  SweepLogIndexEntry key;
+  key.stamp_ns = toNSec(t);
+  key.offset = 0;
+  std::vector<SweepLogIndexEntry>::const_iterator it = std::lower_bound(index_.begin(), index_.end(), key,
+    [](const SweepLogIndexEntry& a, const SweepLogIndexEntry& b) { return a.stamp_ns < b.stamp_ns; });
+  return it - index_.begin();
+}
+
+void SweepLogReader::toPointCloud2(size_t i, sensor_msgs::PointCloud2& cloud) const
+{
+  SweepView view = sweep(i);
+  cloud.header.stamp = view.stamp();
+  cloud.header.frame_id = view.frameId();
+  cloud.width = view.header->width;
+  cloud.height = view.header->height;
+  cloud.point_step = view.header->point_step;
+  cloud.row_step = view.header->row_step;
+  cloud.is_bigendian = view.header->is_bigendian;
+  cloud.is_dense = view.header->is_dense;
+  cloud.fields.resize(view.header->num_fields);
+  for (uint32_t f = 0; f < view.header->num_fields; f++)
+  {
+    cloud.fields[f].name = std::string(view.fields[f].name, strnlen(view.fields[f].name, SWEEP_LOG_FIELD_NAME_LEN));
+    cloud.fields[f].offset = view.fields[f].offset;
+    cloud.fields[f].datatype = view.fields[f].datatype;
+    cloud.fields[f].count = view.fields[f].count;
+  }
+  cloud.data.assign(view.data, view.data + view.header->data_size);
+}
+
+bool SweepLogReader::loadIndex(const SweepLogFileHeader& file_header)
+{
+  const uint64_t index_size = file_header.num_sweeps * sizeof(SweepLogIndexEntry);
+  if (file_header.index_offset == 0 || file_header.num_sweeps > map_size_ / sizeof(SweepLogIndexEntry) ||
+      file_header.index_offset > map_size_ - index_size)
+  {
+    return false;
+  }
+
+  const SweepLogIndexEntry* entries = reinterpret_cast<const SweepLogIndexEntry*>(map_ + file_header.index_offset);
+  for (uint64_t i = 0; i < file_header.num_sweeps; i++)
+  {
+    if (!validChunk(entries[i].offset))
+    {
+      return false;
+    }
+  }
+  index_.assign(entries, entries + file_header.num_sweeps);
+  return true;
+}
+
+bool SweepLogReader::rebuildIndex()
+{
+  index_.clear();
+  size_t offset = alignUp(sizeof(SweepLogFileHeader));
+  while (offset + sizeof(SweepChunkHeader) <= map_size_)
+  {
+    if (!validChunk(offset))
+    {
+      // Truncated or trailing garbage: keep what we have so far
+      break;
+    }
+
+    const SweepChunkHeader* chunk = reinterpret_cast<const SweepChunkHeader*>(map_ + offset);
+    SweepLogIndexEntry entry;
+    entry.stamp_ns = chunk->stamp_ns;
+    entry.offset = offset;
+    index_.push_back(entry);
+    offset += chunk->chunk_size;
+  }
+  ROS_INFO("Recovered %lu sweeps from log", index_.size());
+  return true;
+}
+
+// Checks that everything a SweepView points to lies inside the mapping
+bool SweepLogReader::validChunk(uint64_t offset) const
+{
+  if (offset % SWEEP_LOG_ALIGNMENT != 0 || offset > map_size_ || map_size_ - offset < sizeof(SweepChunkHeader))
+  {
+    return false;
+  }
+
+  const SweepChunkHeader* chunk = reinterpret_cast<const SweepChunkHeader*>(map_ + offset);
+  const uint64_t available = map_size_ - offset;
+  const uint64_t meta_size = sizeof(SweepChunkHeader) + static_cast<uint64_t>(chunk->num_fields) * sizeof(SweepLogField) + chunk->frame_id_len;
+  return chunk->magic == SWEEP_CHUNK_MAGIC &&
+         chunk->chunk_size > 0 && chunk->chunk_size <= available &&
+         chunk->num_fields <= available / sizeof(SweepLogField) &&
+         chunk->data_offset >= meta_size && chunk->data_offset <= chunk->chunk_size &&
+         chunk->data_size <= chunk->chunk_size - chunk->data_offset;
+}
+
+}  // namespace spinning_lidar_utils
@@ -0,0 +1,59 @@
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <spinning_lidar_utils/sweep_log.h>
+
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "sweep_log_player");
+  ros::NodeHandle nh;
+  ros::NodeHandle priv_nh("~");
+
+  std::string sweep_log_path, assembled_cloud_topic;
+  double start_offset, playback_rate;
+  bool loop;
+
+  priv_nh.param("sweep_log_path", sweep_log_path, std::string("sweeps.log"));
+  priv_nh.param("assembled_cloud_topic", assembled_cloud_topic, std::string("spinning_lidar/assembled_cloud"));
+  priv_nh.param("start_offset", start_offset, 0.0);
+  priv_nh.param("playback_rate", playback_rate, 1.0);
+  priv_nh.param("loop", loop, false);
+
+  spinning_lidar_utils::SweepLogReader reader;
+  if (!reader.open(sweep_log_path))
+  {
+    return EXIT_FAILURE;
+  }
+  if (reader.size() == 0)
+  {
+    ROS_WARN("Sweep log '%s' is empty", sweep_log_path.c_str());
+    return EXIT_SUCCESS;
+  }
+
+  ros::Publisher point_cloud_pub = nh.advertise<sensor_msgs::PointCloud2>(assembled_cloud_topic, 1);
+  ros::Duration(1.0).sleep();
+
+  // Jump straight to the first sweep after the requested offset
+  size_t first = reader.seek(reader.stamp(0) + ros::Duration(start_offset));
+  ROS_INFO("Playing %lu sweeps from '%s' on '%s'", reader.size() - first, sweep_log_path.c_str(), assembled_cloud_topic.c_str());
+
+  sensor_msgs::PointCloud2 cloud;
+  do
+  {
+    for (size_t i = first; i < reader.size() && ros::ok(); i++)
+    {
+      reader.toPointCloud2(i, cloud);
+      point_cloud_pub.publish(cloud);
+      ros::spinOnce();
+
+      if (i + 1 < reader.size() && playback_rate > 0.0)
+      {
+        ros::Duration((reader.stamp(i + 1) - reader.stamp(i)).toSec() / playback_rate).sleep();
+      }
+    }
+  } while (loop && ros::ok());
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <spinning_lidar_utils/scan_features.h>
+
+using namespace spinning_lidar_utils;
+
+
+// Rectangular room around the sensor. Two of its corners are inside the
+// 270 deg field of view of the scan.
+const double ROOM_MIN_X = -1.5, ROOM_MAX_X = 2.0, ROOM_MIN_Y = -1.2, ROOM_MAX_Y = 1.4;
+const double CORNERS[2][2] = {{ROOM_MAX_X, ROOM_MIN_Y}, {ROOM_MAX_X, ROOM_MAX_Y}};
+const int NUM_BEAMS = 1081;
+
+double rangeToWall(double angle)
+{
+  const double dx = std::cos(angle), dy = std::sin(angle);
+  double range = 1e9;
+  if (dx > 1e-9) range = std::min(range, ROOM_MAX_X / dx);
+  if (dx < -1e-9) range = std::min(range, ROOM_MIN_X / dx);
+  if (dy > 1e-9) range = std::min(range, ROOM_MAX_Y / dy);
+  if (dy < -1e-9) range = std::min(range, ROOM_MIN_Y / dy);
+  return range;
+}
+
+// Scan at 0.25 deg resolution with gaussian range noise
+sensor_msgs::LaserScan makeNoisyScan(double sigma, std::mt19937& rng)
+{
+  std::normal_distribution<float> noise(0.0, sigma);
+  sensor_msgs::LaserScan scan;
+  scan.angle_min = -135.0 * M_PI / 180.0;
+  scan.angle_increment = 0.25 * M_PI / 180.0;
+  scan.angle_max = scan.angle_min + (NUM_BEAMS - 1) * scan.angle_increment;
+  scan.range_min = 0.02;
+  scan.range_max = 30.0;
+  for (int i = 0; i < NUM_BEAMS; i++)
+  {
+    scan.ranges.push_back(rangeToWall(scan.angle_min + i * scan.angle_increment) + noise(rng));
+  }
+  return scan;
+}
+
+// Distance from the point hit by a beam to the given corner
+double distanceToCorner(const sensor_msgs::LaserScan& scan, int i, int corner)
+{
+  const double angle = scan.angle_min + i * scan.angle_increment;
+  return std::hypot(scan.ranges[i] * std::cos(angle) - CORNERS[corner][0], scan.ranges[i] * std::sin(angle) - CORNERS[corner][1]);
+}
+
+double distanceToCorners(const sensor_msgs::LaserScan& scan, int i)
+{
+  return std::min(distanceToCorner(scan, i, 0), distanceToCorner(scan, i, 1));
+}
+
+
+TEST(ScanFeatures, EdgesLandOnCornersOfNoisyScan)
+{
+  std::mt19937 rng(42);
+  ScanFeatureExtractor extractor;
+  std::vector<uint8_t> labels;
+  for (int trial = 0; trial < 20; trial++)
+  {
+    const sensor_msgs::LaserScan scan = makeNoisyScan(0.01, rng);
+    extractor.extract(scan, labels);
+    ASSERT_EQ(scan.ranges.size(), labels.size());
+
+    bool corner_found[2] = {false, false};
+    for (int i = 0; i < NUM_BEAMS; i++)
+    {
+      if (labels[i] != FEATURE_EDGE)
+      {
+        continue;
+      }
+      EXPECT_LT(distanceToCorners(scan, i), 0.1) << "edge on a wall at beam " << i;
+      for (int corner = 0; corner < 2; corner++)
+      {
+        corner_found[corner] |= distanceToCorner(scan, i, corner) < 0.1;
+      }
+    }
+    EXPECT_TRUE(corner_found[0]);
+    EXPECT_TRUE(corner_found[1]);
+  }
+}
+
+TEST(ScanFeatures, PlanarsStayOnWallsOfNoisyScan)
+{
+  std::mt19937 rng(7);
+  ScanFeatureExtractor extractor;
+  std::vector<uint8_t> labels;
+  for (int trial = 0; trial < 20; trial++)
+  {
+    const sensor_msgs::LaserScan scan = makeNoisyScan(0.03, rng);
+    extractor.extract(scan, labels);
+
+    int num_planars = 0;
+    for (int i = 0; i < NUM_BEAMS; i++)
+    {
+      if (labels[i] == FEATURE_PLANAR)
+      {
+        EXPECT_GT(distanceToCorners(scan, i), 0.1) << "planar on a corner at beam " << i;
+        num_planars++;
+      }
+    }
+    EXPECT_GT(num_planars, 0);
+  }
+}
+
+TEST(ScanFeatures, InvalidWindowLabelsNothing)
+{
+  std::mt19937 rng(3);
+  const sensor_msgs::LaserScan scan = makeNoisyScan(0.01, rng);
+  std::vector<uint8_t> labels;
+  for (int window = -3; window <= 0; window++)
+  {
+    ScanFeatureParams params;
+    params.curvature_window = window;
+    ScanFeatureExtractor extractor(params);
+    extractor.extract(scan, labels);
+    ASSERT_EQ(scan.ranges.size(), labels.size());
+    EXPECT_EQ(0, std::count(labels.begin(), labels.end(), FEATURE_EDGE));
+    EXPECT_EQ(0, std::count(labels.begin(), labels.end(), FEATURE_PLANAR));
+  }
+}
+
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,229 @@
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <spinning_lidar_utils/sweep_log.h>
+
+using namespace spinning_lidar_utils;
+
+
+const size_t NUM_SWEEPS = 10;
+
+std::string logPath(const std::string& name)
+{
+  std::string path = "/tmp/test_sweep_log_" + std::to_string(getpid()) + "_" + name + ".log";
+  unlink(path.c_str());
+  return path;
+}
+
+// Sweep i is stamped at 100 + i seconds, has 3 + i xyz points and every byte of its data set to i
+sensor_msgs::PointCloud2 makeSweep(size_t i)
+{
+  sensor_msgs::PointCloud2 cloud;
+  cloud.header.stamp.sec = 100 + i;
+  cloud.header.frame_id = "laser_mount";
+  cloud.height = 1;
+  cloud.width = 3 + i;
+  cloud.point_step = 12;
+  cloud.row_step = cloud.width * cloud.point_step;
+  const char* names[3] = {"x", "y", "z"};
+  cloud.fields.resize(3);
+  for (int f = 0; f < 3; f++)
+  {
+    cloud.fields[f].name = names[f];
+    cloud.fields[f].offset = 4 * f;
+    cloud.fields[f].datatype = sensor_msgs::PointField::FLOAT32;
+    cloud.fields[f].count = 1;
+  }
+  cloud.data.assign(cloud.row_step, static_cast<uint8_t>(i));
+  return cloud;
+}
+
+void writeLog(const std::string& path)
+{
+  SweepLogWriter writer;
+  ASSERT_TRUE(writer.open(path));
+  for (size_t i = 0; i < NUM_SWEEPS; i++)
+  {
+    ASSERT_TRUE(writer.append(makeSweep(i)));
+  }
+  writer.close();
+}
+
+// Overwrites the 8 bytes at the given position of the file
+void patchFile(const std::string& path, long position, uint64_t value)
+{
+  FILE* file = fopen(path.c_str(), "r+b");
+  ASSERT_TRUE(file != NULL);
+  fseek(file, position, SEEK_SET);
+  fwrite(&value, sizeof(value), 1, file);
+  fclose(file);
+}
+
+// Position in the file of a pointer into the mapped log. The first chunk
+// follows the file header, aligned.
+uint64_t fileOffset(const SweepLogReader& reader, const void* ptr)
+{
+  const uint64_t first_chunk = (sizeof(SweepLogFileHeader) + SWEEP_LOG_ALIGNMENT - 1) / SWEEP_LOG_ALIGNMENT * SWEEP_LOG_ALIGNMENT;
+  return static_cast<const uint8_t*>(ptr) - reinterpret_cast<const uint8_t*>(reader.sweep(0).header) + first_chunk;
+}
+
+void expectSweep(const SweepLogReader& reader, size_t i)
+{
+  sensor_msgs::PointCloud2 cloud;
+  reader.toPointCloud2(i, cloud);
+  sensor_msgs::PointCloud2 expected = makeSweep(i);
+  EXPECT_EQ(expected.header.stamp.sec, cloud.header.stamp.sec);
+  EXPECT_EQ(expected.header.frame_id, cloud.header.frame_id);
+  EXPECT_EQ(expected.width, cloud.width);
+  EXPECT_EQ(expected.point_step, cloud.point_step);
+  ASSERT_EQ(expected.fields.size(), cloud.fields.size());
+  EXPECT_EQ("z", cloud.fields[2].name);
+  EXPECT_EQ(8u, cloud.fields[2].offset);
+  EXPECT_TRUE(expected.data == cloud.data);
+}
+
+
+TEST(SweepLog, RoundTrip)
+{
+  const std::string path = logPath("round_trip");
+  writeLog(path);
+
+  SweepLogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  ASSERT_EQ(NUM_SWEEPS, reader.size());
+  for (size_t i = 0; i < NUM_SWEEPS; i++)
+  {
+    expectSweep(reader, i);
+  }
+
+  SweepView view = reader.sweep(3);
+  EXPECT_EQ(6u, view.numPoints());
+  EXPECT_EQ(4, view.fieldOffset("y"));
+  EXPECT_EQ(-1, view.fieldOffset("intensity"));
+  EXPECT_EQ(3, view.data[0]);
+  unlink(path.c_str());
+}
+
+TEST(SweepLog, Seek)
+{
+  const std::string path = logPath("seek");
+  writeLog(path);
+
+  SweepLogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  ros::Time t;
+  t.sec = 104;
+  EXPECT_EQ(4u, reader.seek(t));
+  t.nsec = 1;
+  EXPECT_EQ(5u, reader.seek(t));
+  t.sec = 50;
+  EXPECT_EQ(0u, reader.seek(t));
+  t.sec = 200;
+  EXPECT_EQ(NUM_SWEEPS, reader.seek(t));
+  unlink(path.c_str());
+}
+
+TEST(SweepLog, RefusesToOverwrite)
+{
+  const std::string path = logPath("overwrite");
+  writeLog(path);
+
+  SweepLogWriter writer;
+  EXPECT_FALSE(writer.open(path));
+
+  SweepLogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  EXPECT_EQ(NUM_SWEEPS, reader.size());
+  unlink(path.c_str());
+}
+
+TEST(SweepLog, RecoversLogWithoutIndex)
+{
+  // As left by a writer that was killed before closing the log
+  const std::string path = logPath("no_index");
+  writeLog(path);
+  patchFile(path, offsetof(SweepLogFileHeader, index_offset), 0);
+
+  SweepLogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  ASSERT_EQ(NUM_SWEEPS, reader.size());
+  expectSweep(reader, NUM_SWEEPS - 1);
+  unlink(path.c_str());
+}
+
+TEST(SweepLog, RecoversTruncatedLog)
+{
+  const std::string path = logPath("truncated");
+  writeLog(path);
+
+  SweepLogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  // Cut the file in the middle of the data of the last sweep
+  const off_t cut = fileOffset(reader, reader.sweep(NUM_SWEEPS - 1).data) + 16;
+  reader.close();
+  ASSERT_EQ(0, truncate(path.c_str(), cut));
+
+  ASSERT_TRUE(reader.open(path));
+  ASSERT_EQ(NUM_SWEEPS - 1, reader.size());
+  expectSweep(reader, NUM_SWEEPS - 2);
+  unlink(path.c_str());
+}
+
+TEST(SweepLog, RejectsCorruptIndex)
+{
+  const std::string path = logPath("corrupt_index");
+  writeLog(path);
+
+  uint64_t index_offset;
+  {
+    FILE* file = fopen(path.c_str(), "rb");
+    ASSERT_TRUE(file != NULL);
+    SweepLogFileHeader file_header;
+    ASSERT_EQ(1u, fread(&file_header, sizeof(file_header), 1, file));
+    fclose(file);
+    index_offset = file_header.index_offset;
+  }
+  // Point the offset of the 3rd entry far outside the file
+  patchFile(path, index_offset + 2 * sizeof(SweepLogIndexEntry) + offsetof(SweepLogIndexEntry, offset), 1ull << 40);
+
+  SweepLogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  ASSERT_EQ(NUM_SWEEPS, reader.size());
+  expectSweep(reader, 2);
+  unlink(path.c_str());
+}
+
+TEST(SweepLog, RejectsCorruptChunk)
+{
+  const std::string path = logPath("corrupt_chunk");
+  writeLog(path);
+
+  uint64_t chunk_offset;
+  {
+    SweepLogReader reader;
+    ASSERT_TRUE(reader.open(path));
+    chunk_offset = fileOffset(reader, reader.sweep(5).header);
+  }
+  // Data of the 6th sweep claims to be larger than its chunk
+  patchFile(path, chunk_offset + offsetof(SweepChunkHeader, data_size), 1ull << 30);
+
+  // The index is not trusted, the chunks are walked and the log stops before the bad one
+  SweepLogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  ASSERT_EQ(5u, reader.size());
+  expectSweep(reader, 4);
+  unlink(path.c_str());
+}
+
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}